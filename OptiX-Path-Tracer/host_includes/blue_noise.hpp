@@ -0,0 +1,118 @@
+#ifndef BLUENOISEH
+#define BLUENOISEH
+
+// blue_noise.hpp: Define the blue noise dither mask generation
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "host_common.hpp"
+
+const int BLUE_NOISE_SIZE = 64;  // tile width and height, a power of 2
+
+// Generates a tileable blue noise mask with the void and cluster method
+// ("The void-and-cluster method for dither array generation", Ulichney).
+// Returns the rank of each pixel, from 0 to size * size - 1.
+std::vector<int> voidAndCluster(int size, float sigma = 1.5f) {
+  const int n = size * size;
+
+  // gaussian filter with toroidal distances, so the mask tiles seamlessly
+  std::vector<float> filter(n);
+  for (int y = 0; y < size; y++)
+    for (int x = 0; x < size; x++) {
+      int dx = std::min(x, size - x), dy = std::min(y, size - y);
+      filter[y * size + x] = expf(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+    }
+
+  std::vector<bool> pattern(n, false);
+  std::vector<float> energy(n, 0.f);
+  auto toggle = [&](int p, bool value) {
+    pattern[p] = value;
+    float sign = value ? 1.f : -1.f;
+    int px = p % size, py = p / size;
+    for (int y = 0; y < size; y++)
+      for (int x = 0; x < size; x++)
+        energy[y * size + x] += sign * filter[((y - py) & (size - 1)) * size +
+                                              ((x - px) & (size - 1))];
+  };
+
+  // the tightest cluster is the set pixel with the highest energy, and the
+  // largest void the empty pixel with the lowest one
+  auto tightestCluster = [&]() {
+    int best = -1;
+    for (int p = 0; p < n; p++)
+      if (pattern[p] && (best < 0 || energy[p] > energy[best])) best = p;
+    return best;
+  };
+  auto largestVoid = [&]() {
+    int best = -1;
+    for (int p = 0; p < n; p++)
+      if (!pattern[p] && (best < 0 || energy[p] < energy[best])) best = p;
+    return best;
+  };
+
+  // fixed seed, so every run gets the same mask
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> dis(0, n - 1);
+  int ones = n / 10;
+  for (int i = 0; i < ones;) {
+    int p = dis(gen);
+    if (!pattern[p]) {
+      toggle(p, true);
+      i++;
+    }
+  }
+
+  // spread the initial points evenly, moving the tightest cluster to the
+  // largest void until it stays in place
+  while (true) {
+    int cluster = tightestCluster();
+    toggle(cluster, false);
+    int hole = largestVoid();
+    toggle(hole, true);
+    if (hole == cluster) break;
+  }
+
+  std::vector<int> rank(n);
+  std::vector<bool> initial = pattern;
+  std::vector<float> initialEnergy = energy;
+
+  // ranks of the initial points, removing clusters first
+  for (int r = ones - 1; r >= 0; r--) {
+    int cluster = tightestCluster();
+    toggle(cluster, false);
+    rank[cluster] = r;
+  }
+
+  // the remaining ranks fill voids. Past half the pixels, the largest void
+  // is also the tightest cluster of empty pixels.
+  pattern = initial;
+  energy = initialEnergy;
+  for (int r = ones; r < n; r++) {
+    int hole = largestVoid();
+    toggle(hole, true);
+    rank[hole] = r;
+  }
+
+  return rank;
+}
+
+// Create the blue noise dither mask buffer(unsigned char), quantizing its
+// ranks to bytes. It's the same in every render, so it's only built once.
+Buffer createBlueNoiseBuffer(Context &g_context) {
+  static std::vector<int> rank = voidAndCluster(BLUE_NOISE_SIZE);
+
+  Buffer buffer = g_context->createBuffer(RT_BUFFER_INPUT);
+  buffer->setFormat(RT_FORMAT_UNSIGNED_BYTE);
+  buffer->setSize(BLUE_NOISE_SIZE, BLUE_NOISE_SIZE);
+
+  unsigned char *data = static_cast<unsigned char *>(buffer->map());
+  for (int i = 0; i < rank.size(); i++)
+    data[i] = (unsigned char)(rank[i] * 256 / rank.size());
+  buffer->unmap();
+
+  return buffer;
+}
+
+#endif
@@ -3,15 +3,18 @@
 
 // buffers.hpp: Define buffer creation functions
 
+#include <cstring>
+
 #include "host_common.hpp"
 
 /////////////////////////////
 // Output buffer functions //
 /////////////////////////////
 
-// Create a frame buffer(float4) with given dimensions
+// Create a frame buffer(float4) with given dimensions. It's also an input, so
+// checkpoints can be loaded back into it.
 Buffer createFrameBuffer(int Nx, int Ny, Context &g_context) {
-  Buffer pixelBuffer = g_context->createBuffer(RT_BUFFER_OUTPUT);
+  Buffer pixelBuffer = g_context->createBuffer(RT_BUFFER_INPUT_OUTPUT);
   pixelBuffer->setFormat(RT_FORMAT_FLOAT4);
   pixelBuffer->setSize(Nx, Ny);
   return pixelBuffer;
@@ -25,6 +28,56 @@ Buffer createDisplayBuffer(int Nx, int Ny, Context &g_context) {
   return pixelBuffer;
 }
 
+// Create a per pixel float buffer with given dimensions
+Buffer createFloatBuffer(int Nx, int Ny, Context &g_context) {
+  Buffer pixelBuffer = g_context->createBuffer(RT_BUFFER_INPUT_OUTPUT);
+  pixelBuffer->setFormat(RT_FORMAT_FLOAT);
+  pixelBuffer->setSize(Nx, Ny);
+  return pixelBuffer;
+}
+
+// Create a single uint counter, zeroed, that the device can increment
+Buffer createCounterBuffer(Context &g_context) {
+  Buffer buffer = g_context->createBuffer(RT_BUFFER_INPUT_OUTPUT);
+  buffer->setFormat(RT_FORMAT_UNSIGNED_INT);
+  buffer->setSize(1);
+
+  *static_cast<unsigned int *>(buffer->map()) = 0u;
+  buffer->unmap();
+
+  return buffer;
+}
+
+// Create the path state buffers of the wavefront integrator, one path per
+// pixel, and the queues and counter used to compact them. They're only
+// needed when it's on, so a single element is enough otherwise.
+void createPathBuffers(int Nx, int Ny, Context &g_context) {
+  size_t n = (size_t)Nx * Ny;
+
+  auto create = [&](const char *name, RTformat format, size_t width,
+                    size_t height = 1) {
+    Buffer buffer = g_context->createBuffer(RT_BUFFER_INPUT_OUTPUT);
+    buffer->setFormat(format);
+    if (height > 1)
+      buffer->setSize(width, height);
+    else
+      buffer->setSize(width);
+    g_context[name]->set(buffer);
+    return buffer;
+  };
+
+  create("path_origin", RT_FORMAT_FLOAT3, n);
+  create("path_direction", RT_FORMAT_FLOAT3, n);
+  create("path_throughput", RT_FORMAT_FLOAT3, n);
+  create("path_radiance", RT_FORMAT_FLOAT3, n);
+  create("path_cone", RT_FORMAT_FLOAT2, n);
+  create("path_time", RT_FORMAT_FLOAT, n);
+  create("path_sampler", RT_FORMAT_UNSIGNED_INT4, n);
+  create("path_state", RT_FORMAT_INT2, n);
+  create("path_queue", RT_FORMAT_UNSIGNED_INT, n, 2);
+  g_context["alive_paths"]->set(createCounterBuffer(g_context));
+}
+
 ////////////////////////////
 // Input buffer functions //
 ////////////////////////////
@@ -137,4 +190,40 @@ Buffer createBuffer(std::vector<uint3> &list, Context &g_context) {
   return buffer;
 }
 
+// Create an input buffer of the given format, copying the array as is
+Buffer createBuffer(const void *list, size_t size, RTformat format,
+                    size_t elementSize, Context &g_context) {
+  Buffer buffer = g_context->createBuffer(RT_BUFFER_INPUT);
+  buffer->setFormat(format);
+  buffer->setSize(size);
+
+  if (size > 0) {
+    memcpy(buffer->map(), list, size * elementSize);
+    buffer->unmap();
+  }
+
+  return buffer;
+}
+
+// Create float2 OptiX buffer from an array
+Buffer createBuffer(const float2 *list, size_t size, Context &g_context) {
+  return createBuffer(list, size, RT_FORMAT_FLOAT2, sizeof(float2), g_context);
+}
+
+// Create float3 OptiX buffer from an array
+Buffer createBuffer(const float3 *list, size_t size, Context &g_context) {
+  return createBuffer(list, size, RT_FORMAT_FLOAT3, sizeof(float3), g_context);
+}
+
+// Create int OptiX buffer from an array
+Buffer createBuffer(const int *list, size_t size, Context &g_context) {
+  return createBuffer(list, size, RT_FORMAT_INT, sizeof(int), g_context);
+}
+
+// Create uint3 OptiX buffer from an array
+Buffer createBuffer(const uint3 *list, size_t size, Context &g_context) {
+  return createBuffer(list, size, RT_FORMAT_UNSIGNED_INT3, sizeof(uint3),
+                      g_context);
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,140 @@
+#ifndef CHECKPOINTHPP
+#define CHECKPOINTHPP
+
+// checkpoint.hpp: Define functions to save and resume unfinished renders
+
+#include <cstring>
+#include <vector>
+
+#include "host_common.hpp"
+
+// Checkpoint files start with this header, followed by the W * H float4
+// accumulated colors and, if adaptive sampling was on, the W * H float
+// luminance moments. Scene, model and resolution identify the camera, since
+// cameras are fixed by the scene functions, and the sampler identifies the
+// random sequences the remaining samples continue.
+struct Checkpoint_Header {
+  char magic[4];
+  int version;
+  int scene, model, W, H;
+  int sampler;     // Sampler_Type of the samples
+  int frame;       // number of samples already traced
+  int hasMoments;  // adaptive sampling moments follow the colors
+};
+
+const char CHECKPOINT_MAGIC[4] = {'O', 'P', 'T', 'C'};
+const int CHECKPOINT_VERSION = 2;
+
+// Saves the acc buffer and the current sample to disk. The file is written
+// under a temporary name first, so an interrupted save doesn't destroy the
+// previous checkpoint.
+bool Save_Checkpoint(App_State &app, const std::string &name) {
+  Checkpoint_Header header;
+  memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+  header.version = CHECKPOINT_VERSION;
+  header.scene = app.scene;
+  header.model = app.model;
+  header.W = app.W;
+  header.H = app.H;
+  header.sampler = app.sampler;
+  header.frame = app.currentSample;
+  header.hasMoments = app.noiseThreshold > 0.f;
+
+  std::string tempName = name + ".tmp";
+  FILE *file = fopen(tempName.c_str(), "wb");
+  if (!file) return false;
+
+  size_t pixels = size_t(app.W) * app.H;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  const float4 *cols = (const float4 *)app.accBuffer->map();
+  ok = ok && fwrite(cols, sizeof(float4), pixels, file) == pixels;
+  app.accBuffer->unmap();
+
+  if (header.hasMoments) {
+    const float *moments = (const float *)app.momentBuffer->map();
+    ok = ok && fwrite(moments, sizeof(float), pixels, file) == pixels;
+    app.momentBuffer->unmap();
+  }
+
+  ok = (fclose(file) == 0) && ok;
+  if (!ok) {
+    remove(tempName.c_str());
+    return false;
+  }
+
+  // rename doesn't replace existing files on Windows
+  remove(name.c_str());
+  return rename(tempName.c_str(), name.c_str()) == 0;
+}
+
+// Loads a checkpoint into the acc buffer, and sets the current sample to the
+// one the render stopped at. Should be called after the context is
+// configured with the same settings the checkpoint was saved with.
+bool Load_Checkpoint(App_State &app, const std::string &name) {
+  FILE *file = fopen(name.c_str(), "rb");
+  if (!file) {
+    printf("Couldn't open checkpoint '%s'.\n", name.c_str());
+    return false;
+  }
+
+  Checkpoint_Header header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, CHECKPOINT_MAGIC, 4) ||
+      header.version != CHECKPOINT_VERSION) {
+    printf("'%s' isn't a valid checkpoint file.\n", name.c_str());
+    fclose(file);
+    return false;
+  }
+
+  if (header.scene != app.scene || header.model != app.model ||
+      header.W != app.W || header.H != app.H ||
+      header.sampler != app.sampler) {
+    const char *samplers[] = {"random", "sobol", "blue-noise"};
+    const char *sampler = (header.sampler >= 0 && header.sampler <= 2)
+                              ? samplers[header.sampler]
+                              : "unknown";
+    printf("Checkpoint was saved with scene %d, model %d, at %dx%d, with the "
+           "%s sampler.\n",
+           header.scene, header.model, header.W, header.H, sampler);
+    fclose(file);
+    return false;
+  }
+
+  // moments starting at zero would make every pixel look converged
+  if (app.noiseThreshold > 0.f && !header.hasMoments) {
+    printf("Checkpoint was saved without adaptive sampling.\n");
+    fclose(file);
+    return false;
+  }
+
+  size_t pixels = size_t(app.W) * app.H;
+  float4 *cols = (float4 *)app.accBuffer->map();
+  bool ok = fread(cols, sizeof(float4), pixels, file) == pixels;
+  app.accBuffer->unmap();
+
+  if (ok && header.hasMoments) {
+    std::vector<float> moments(pixels);
+    ok = fread(moments.data(), sizeof(float), pixels, file) == pixels;
+
+    // moments are only kept if this render is also adaptive
+    if (ok && app.noiseThreshold > 0.f) {
+      float *data = (float *)app.momentBuffer->map();
+      memcpy(data, moments.data(), pixels * sizeof(float));
+      app.momentBuffer->unmap();
+    }
+  }
+
+  fclose(file);
+
+  if (!ok) {
+    printf("Checkpoint '%s' is truncated.\n", name.c_str());
+    return false;
+  }
+
+  app.currentSample = header.frame;
+
+  return true;
+}
+
+#endif
@@ -3,6 +3,8 @@
 
 // gui.hpp: Define functions and include libraries used by GUI
 
+#include <cstring>
+
 #include "host_common.hpp"
 #include "scenes.hpp"
 
@@ -45,4 +47,66 @@ static void ShowHelpMarker(const char *desc) {
   }
 }
 
+// Render preview. The display buffer is streamed to a single persistent
+// texture through two pixel buffer objects: each update uploads the PBO
+// filled by the previous update to the texture, while the other PBO gets the
+// newest display buffer, so the texture upload doesn't stall on the copy.
+struct Preview {
+  // Creates the texture and PBOs for a W x H display buffer
+  void init(int width, int height) {
+    W = width;
+    H = height;
+    size = W * H * sizeof(uchar4);
+    index = 0;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, W, H, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(2, pbos);
+    for (int i = 0; i < 2; i++) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  // Reads the display buffer back, showing it on the next update
+  void update(Buffer &displayBuffer) {
+    // upload the previous readback to the texture
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[index]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, W, H, GL_RGBA, GL_UNSIGNED_BYTE,
+                    0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // copy the display buffer to the other PBO, orphaning its old storage
+    index = 1 - index;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[index]);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+    void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, access);
+    if (dst) {
+      memcpy(dst, displayBuffer->map(), size);
+      displayBuffer->unmap();
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+
+  // Releases the GL objects
+  void destroy() {
+    glDeleteBuffers(2, pbos);
+    glDeleteTextures(1, &texture);
+  }
+
+  int W, H, index;
+  size_t size;
+  GLuint texture = 0, pbos[2] = {0, 0};  // zero until init is called
+};
+
 #endif
\ No newline at end of file
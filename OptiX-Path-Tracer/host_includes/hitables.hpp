@@ -9,6 +9,7 @@
 /*! The precompiled programs code (in ptx) that our cmake script
 will precompile (to ptx) and link to the generated executable */
 extern "C" const char Sphere_PTX[];
+extern "C" const char Sphere_Batch_PTX[];
 extern "C" const char Volume_Sphere_PTX[];
 extern "C" const char Moving_Sphere_PTX[];
 extern "C" const char AARect_PTX[];
@@ -100,7 +101,7 @@ class Sphere : public Hitable {
     gi->setMaterial(0, material->assignTo(g_context));
 
     // Create Geometry parameters callable program
-    Program prog = createProgram(Sphere_PTX, "Get_HitRecord", g_context);
+    Program prog = getProgram(Sphere_PTX, "Get_HitRecord", g_context);
 
     // Basic Parameters
     gi["center"]->setFloat(center.x, center.y, center.z);
@@ -112,9 +113,9 @@ class Sphere : public Hitable {
     geometry->setPrimitiveCount(1);
 
     // Set intersection and bounding box programs
-    Program bb = createProgram(Sphere_PTX, "get_bounds", g_context);
+    Program bb = getProgram(Sphere_PTX, "get_bounds", g_context);
     geometry->setBoundingBoxProgram(bb);
-    Program hit = createProgram(Sphere_PTX, "hit_sphere", g_context);
+    Program hit = getProgram(Sphere_PTX, "hit_sphere", g_context);
     geometry->setIntersectionProgram(hit);
 
     gi->setGeometry(geometry);
@@ -127,6 +128,81 @@ class Sphere : public Hitable {
   const float radius;   // radius of the sphere
 };
 
+// Creates a batch of spheres sharing a single Geometry, so they all end up in
+// one bottom level BVH. Each sphere can have a different material.
+class Sphere_Batch : public Hitable {
+ public:
+  Sphere_Batch() : Hitable(nullptr) {}
+
+  // Appends a sphere to the batch and returns its index
+  int push(const float3 &center, const float radius, BRDF *material) {
+    int index = (int)spheres.size();
+
+    spheres.push_back(make_float4(center.x, center.y, center.z, radius));
+    materials.push_back(material);
+
+    return index;
+  }
+
+  // Creates a GeometryInstance object with every sphere of the batch
+  virtual GeometryInstance getGeometryInstance(Context &g_context) override {
+    GeometryInstance gi = g_context->createGeometryInstance();
+
+    // Materials are shared between spheres with identical materials, the
+    // intersection program reports each sphere's material index
+    std::vector<Material> gi_materials;
+    std::map<RTmaterial, int> material_map;
+    std::vector<int> indices;
+    for (int i = 0; i < (int)materials.size(); i++) {
+      Material mat = materials[i]->assignTo(g_context);
+
+      auto it = material_map.find(mat->get());
+      if (it == material_map.end()) {
+        it = material_map.insert({mat->get(), (int)gi_materials.size()}).first;
+        gi_materials.push_back(mat);
+      }
+
+      indices.push_back(it->second);
+    }
+
+    gi->setMaterialCount((int)gi_materials.size());
+    for (int i = 0; i < (int)gi_materials.size(); i++)
+      gi->setMaterial(i, gi_materials[i]);
+
+    // Create Geometry parameters callable program
+    Program prog = getProgram(Sphere_Batch_PTX, "Get_HitRecord", g_context);
+
+    // Basic Parameters
+    Buffer sphere_buffer = g_context->createBuffer(
+        RT_BUFFER_INPUT, RT_FORMAT_FLOAT4, spheres.size());
+    float4 *data = static_cast<float4 *>(sphere_buffer->map());
+    for (int i = 0; i < (int)spheres.size(); i++) data[i] = spheres[i];
+    sphere_buffer->unmap();
+
+    gi["sphere_buffer"]->setBuffer(sphere_buffer);
+    gi["material_buffer"]->setBuffer(createBuffer(indices, g_context));
+    gi["Get_HitRecord"]->set(prog);
+
+    // Create Geometry variable
+    Geometry geometry = g_context->createGeometry();
+    geometry->setPrimitiveCount((int)spheres.size());
+
+    // Set intersection and bounding box programs
+    Program bb = getProgram(Sphere_Batch_PTX, "get_bounds", g_context);
+    geometry->setBoundingBoxProgram(bb);
+    Program hit = getProgram(Sphere_Batch_PTX, "hit_sphere", g_context);
+    geometry->setIntersectionProgram(hit);
+
+    gi->setGeometry(geometry);
+
+    return gi;
+  }
+
+ protected:
+  std::vector<float4> spheres;   // centers in xyz and radii in w
+  std::vector<BRDF *> materials;  // host side material of each sphere
+};
+
 // FIXME: not working, adapt to OptiX's motion blur
 class Moving_Sphere : public Hitable {
  public:
@@ -146,11 +222,11 @@ class Moving_Sphere : public Hitable {
     geometry->setPrimitiveCount(1);
 
     // Set bounding box program
-    Program bb = createProgram(Moving_Sphere_PTX, "get_bounds", g_context);
+    Program bb = getProgram(Moving_Sphere_PTX, "get_bounds", g_context);
     geometry->setBoundingBoxProgram(bb);
 
     // Set intersection program
-    Program hit = createProgram(Moving_Sphere_PTX, "hit_sphere", g_context);
+    Program hit = getProgram(Moving_Sphere_PTX, "hit_sphere", g_context);
     geometry->setIntersectionProgram(hit);
 
     // Basic Parameters
@@ -185,11 +261,11 @@ class Volumetric_Sphere : public Hitable {
     geometry->setPrimitiveCount(1);
 
     // Set bounding box program
-    Program bound = createProgram(Volume_Sphere_PTX, "get_bounds", g_context);
+    Program bound = getProgram(Volume_Sphere_PTX, "get_bounds", g_context);
     geometry->setBoundingBoxProgram(bound);
 
     // Set intersection program
-    Program hit = createProgram(Volume_Sphere_PTX, "hit_sphere", g_context);
+    Program hit = getProgram(Volume_Sphere_PTX, "hit_sphere", g_context);
     geometry->setIntersectionProgram(hit);
 
     // Basic Parameters
@@ -242,13 +318,13 @@ class AARect : public Hitable {
     geometry->setPrimitiveCount(1);
 
     // Create intersection and bounding box programs
-    Program bound = createProgram(AARect_PTX, "Get_Bounds", g_context);
+    Program bound = getProgram(AARect_PTX, "Get_Bounds", g_context);
     geometry->setBoundingBoxProgram(bound);
-    Program intersect = createProgram(AARect_PTX, "Hit_Rect", g_context);
+    Program intersect = getProgram(AARect_PTX, "Hit_Rect", g_context);
     geometry->setIntersectionProgram(intersect);
 
     // Create Geometry parameters callable program
-    Program prog = createProgram(AARect_PTX, "Get_HitRecord", g_context);
+    Program prog = getProgram(AARect_PTX, "Get_HitRecord", g_context);
 
     // Basic Parameters
     gi["axis"]->setInt(int(axis));
@@ -290,15 +366,15 @@ class Box : public Hitable {
     geometry->setPrimitiveCount(1);
 
     // Set bounding box program
-    Program bound = createProgram(Box_PTX, "Get_Bounds", g_context);
+    Program bound = getProgram(Box_PTX, "Get_Bounds", g_context);
     geometry->setBoundingBoxProgram(bound);
 
     // Set intersection program
-    Program intersect = createProgram(Box_PTX, "Intersect", g_context);
+    Program intersect = getProgram(Box_PTX, "Intersect", g_context);
     geometry->setIntersectionProgram(intersect);
 
     // Create Geometry parameters callable program
-    Program prog = createProgram(Box_PTX, "Get_HitRecord", g_context);
+    Program prog = getProgram(Box_PTX, "Get_HitRecord", g_context);
 
     // Basic parameters
     gi["boxmin"]->setFloat(p0.x, p0.y, p0.z);
@@ -328,11 +404,11 @@ class Volumetric_Box : public Hitable {
     geometry->setPrimitiveCount(1);
 
     // Set bounding box program
-    Program bound = createProgram(Volume_Box_PTX, "get_bounds", g_context);
+    Program bound = getProgram(Volume_Box_PTX, "get_bounds", g_context);
     geometry->setBoundingBoxProgram(bound);
 
     // Set intersection program
-    Program intersect = createProgram(Volume_Box_PTX, "hit_volume", g_context);
+    Program intersect = getProgram(Volume_Box_PTX, "hit_volume", g_context);
     geometry->setIntersectionProgram(intersect);
 
     // Basic parameters
@@ -371,11 +447,11 @@ class Triangle : public Hitable {
     geometry->setPrimitiveCount(1);
 
     // Set bounding box program
-    Program bound = createProgram(Triangle_PTX, "get_bounds", g_context);
+    Program bound = getProgram(Triangle_PTX, "get_bounds", g_context);
     geometry->setBoundingBoxProgram(bound);
 
     // Set intersection program
-    Program intersect = createProgram(Triangle_PTX, "hit_triangle", g_context);
+    Program intersect = getProgram(Triangle_PTX, "hit_triangle", g_context);
     geometry->setIntersectionProgram(intersect);
 
     // basic parameters
@@ -429,15 +505,15 @@ class Cylinder : public Hitable {
     geometry->setPrimitiveCount(1);
 
     // Set bounding box program
-    Program bound = createProgram(Cylinder_PTX, "Get_Bounds", g_context);
+    Program bound = getProgram(Cylinder_PTX, "Get_Bounds", g_context);
     geometry->setBoundingBoxProgram(bound);
 
     // Set intersection program
-    Program intersect = createProgram(Cylinder_PTX, "Intersect", g_context);
+    Program intersect = getProgram(Cylinder_PTX, "Intersect", g_context);
     geometry->setIntersectionProgram(intersect);
 
     // Create Geometry parameters callable program
-    Program prog = createProgram(Cylinder_PTX, "Get_HitRecord", g_context);
+    Program prog = getProgram(Cylinder_PTX, "Get_HitRecord", g_context);
 
     // Basic Parameters
     gi["O"]->setFloat(O.x, O.y, O.z);
@@ -517,12 +593,29 @@ class Hitable_List {
     addAndTransform(gg, d_world, g_context, transforms);
   }
 
-  // adds and transforms each list element to the scene graph individually
+  // adds and transforms each list element to the scene graph individually.
+  // Elements without transforms share a single GeometryGroup and BVH, only
+  // transformed ones get their own Transform node.
   void addElementsTo(Group &d_world, Context &g_context) {
+    GeometryGroup gg;
+
     for (int i = 0; i < (int)hitList.size(); i++) {
       GeometryInstance gi = hitList[i]->getGeometryInstance(g_context);
-      addAndTransform(gi, d_world, g_context, hitList[i]->transforms);
+
+      if (hitList[i]->transforms.empty()) {
+        if (!gg) {
+          gg = g_context->createGeometryGroup();
+          gg->setAcceleration(g_context->createAcceleration("Trbvh"));
+        }
+
+        gg->addChild(gi);
+      } else
+        addAndTransform(gi, d_world, g_context, hitList[i]->transforms);
     }
+
+    if (gg)
+      addAndTransform(gg, d_world, g_context,
+                      std::vector<TransformParameter>());
   }
 
  protected:
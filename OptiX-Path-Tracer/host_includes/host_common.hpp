@@ -3,9 +3,20 @@
 #define _USE_MATH_DEFINES 1
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <random>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #include "../programs/vec.hpp"
 
@@ -17,6 +28,16 @@
 
 #include "../lib/HDRloader.h"
 
+// Set when rendering from the command line, without a window. There's nobody
+// around to press a key in batch mode, so errors shouldn't wait for input.
+bool batchMode = false;
+
+// Waits for a key press, unless running in batch mode, and exits the program
+void exitOnError() {
+  if (!batchMode) system("PAUSE");
+  exit(1);
+}
+
 // Struct used to keep GUI state
 struct App_State {
   // Default Constructor
@@ -24,22 +45,35 @@ struct App_State {
     context = Context::create(); // OptiX context
     W = H = 500;          // image resolution
     samples = 500;        // number of samples
+    samplesPerLaunch = 1; // samples traced by each launch
+    tileSize = 0;         // render the whole frame in each launch
+    noiseThreshold = 0.f; // adaptive sampling is off
+    sampler = 1;          // RANDOM = 0, SOBOL = 1
+    warmupSamples = 16;   // samples before testing for convergence
+    timeBudget = 0.f;     // no time limit, in seconds
     scene = 2;            // counter to selection scene function
     model = 0;            // model selection for mesh test scene
-    frequency = 1;        // update preview at every sample
+    frequency = 1;        // update preview at every launch
+    previewInterval = 0.1f; // but at most 10 times per second
     currentSample = 0;    // always start at sample 0
     showProgress = true;  // display preview?
     RTX = true;           // use RTX mode
+    wavefront = false;    // trace whole paths in a single launch
     start = done = false; // hasn't started and it's not yet done
     fileType = 0;         // PNG = 0, HDR = 1
     fileName = "out";     // file name without extension
+    checkpointName = "";  // don't save checkpoints
+    saveInterval = 300.f; // seconds between checkpoints
+    resume = false;       // start a new render
   }
 
   Context context;
-  int W, H, samples, scene, currentSample, model, frequency, fileType;
-  bool done, start, showProgress, RTX;
-  Buffer accBuffer, displayBuffer;
-  std::string fileName;
+  int W, H, samples, samplesPerLaunch, tileSize, warmupSamples, scene,
+      currentSample, model, frequency, fileType, sampler;
+  float noiseThreshold, timeBudget, saveInterval, previewInterval;
+  bool done, start, showProgress, RTX, resume, wavefront;
+  Buffer accBuffer, displayBuffer, momentBuffer, activeBuffer;
+  std::string fileName, checkpointName;
 };
 
 // encapsulates PTX string program creation
@@ -54,15 +88,281 @@ Program createProgram(const char file[], const std::string &name,
   return program;
 }
 
+// Returns a program shared by every object using the same PTX entry, creating
+// it once per context. Only for programs that read their variables from other
+// scopes; programs that get variables of their own use createProgram.
+Program getProgram(const char file[], const std::string &name,
+                   Context &g_context) {
+  typedef std::tuple<RTcontext, const char *, std::string> Program_Key;
+  static std::map<Program_Key, Program> cache;
+
+  Program_Key key(g_context->get(), file, name);
+  auto it = cache.find(key);
+  if (it != cache.end()) return it->second;
+
+  Program program = createProgram(file, name, g_context);
+  cache[key] = program;
+
+  return program;
+}
+
+// Identifies an object by its type and parameter values, so identical host
+// objects can share a device object. Floats are written in hex, so only
+// bitwise identical values match. Adding an empty string, the key of an
+// object that can't be shared, makes the whole key empty.
+struct Param_Key {
+  Param_Key(const char *type) : valid(true) { ss << std::hexfloat << type; }
+
+  Param_Key &operator<<(const float v) {
+    ss << ' ' << v;
+    return *this;
+  }
+
+  Param_Key &operator<<(const int v) {
+    ss << ' ' << v;
+    return *this;
+  }
+
+  Param_Key &operator<<(const float3 &v) { return *this << v.x << v.y << v.z; }
+
+  // strings are length prefixed, so nested keys can't be confused
+  Param_Key &operator<<(const std::string &v) {
+    if (v.empty()) valid = false;
+    ss << ' ' << v.size() << ':' << v;
+    return *this;
+  }
+
+  operator std::string() const { return valid ? ss.str() : ""; }
+
+  std::ostringstream ss;
+  bool valid;
+};
+
+// Returns the object cached under the given key for this context, creating it
+// if needed. Objects with empty keys are always created and never cached.
+template <typename T, typename Create_Function>
+T getShared(std::map<std::pair<RTcontext, std::string>, T> &cache,
+            const std::string &key, Context &g_context,
+            Create_Function create) {
+  if (key.empty()) return create();
+
+  std::pair<RTcontext, std::string> id(g_context->get(), key);
+  auto it = cache.find(id);
+  if (it != cache.end()) return it->second;
+
+  T object = create();
+  cache[id] = object;
+
+  return object;
+}
+
+// Worker threads shared by every parallelFor call. They're started on first
+// use and sleep between calls, so short loops don't pay for thread creation.
+struct Thread_Pool {
+  static Thread_Pool &get() {
+    static Thread_Pool pool;
+    return pool;
+  }
+
+  // threads that run tasks, counting the calling one
+  size_t size() const { return workers.size() + 1; }
+
+  // true on a thread that is running a task, where nested calls run serially
+  static bool &inTask() {
+    static thread_local bool running = false;
+    return running;
+  }
+
+  // Calls task(t) for every t in [0, count) on the workers and the calling
+  // thread. Returns once all calls are done, rethrowing the first exception
+  // a task threw.
+  void run(size_t count, const std::function<void(size_t)> &task) {
+    if (inTask()) {
+      for (size_t t = 0; t < count; t++) task(t);
+      return;
+    }
+
+    std::lock_guard<std::mutex> submit(submitMutex);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job = &task;
+      n_tasks = pending = count;
+      next = 0;
+      error = nullptr;
+    }
+    wake.notify_all();
+
+    work();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&]() { return pending == 0; });
+    job = nullptr;
+    if (error) std::rethrow_exception(error);
+  }
+
+ private:
+  Thread_Pool() {
+    size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t t = 1; t < n_threads; t++)
+      workers.emplace_back([this]() { workerLoop(); });
+  }
+
+  ~Thread_Pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    wake.notify_all();
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+  }
+
+  void workerLoop() {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return stop || (job && next < n_tasks); });
+        if (stop) return;
+      }
+      work();
+    }
+  }
+
+  // Takes tasks of the current job until there are none left
+  void work() {
+    while (true) {
+      const std::function<void(size_t)> *task;
+      size_t t;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!job || next >= n_tasks) return;
+        task = job;
+        t = next++;
+      }
+
+      std::exception_ptr taskError;
+      inTask() = true;
+      try {
+        (*task)(t);
+      } catch (...) {
+        taskError = std::current_exception();
+      }
+      inTask() = false;
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (taskError && !error) error = taskError;
+      if (--pending == 0) done.notify_all();
+    }
+  }
+
+  std::vector<std::thread> workers;
+  std::mutex mutex, submitMutex;
+  std::condition_variable wake, done;
+  const std::function<void(size_t)> *job = nullptr;
+  size_t n_tasks = 0, next = 0, pending = 0;
+  std::exception_ptr error;
+  bool stop = false;
+};
+
+// Calls func(i) for every i in [0, count), spreading contiguous ranges of
+// indices over the thread pool. Returns once all calls are done, rethrowing
+// an exception thrown by func on the calling thread.
+template <typename Function>
+void parallelFor(size_t count, Function func) {
+  Thread_Pool &pool = Thread_Pool::get();
+  size_t n_ranges = Thread_Pool::inTask() ? 1 : pool.size();
+  n_ranges = std::min(n_ranges, count);
+
+  if (n_ranges <= 1) {
+    for (size_t i = 0; i < count; i++) func(i);
+    return;
+  }
+
+  pool.run(n_ranges, [&](size_t r) {
+    size_t begin = count * r / n_ranges;
+    size_t end = count * (r + 1) / n_ranges;
+    for (size_t i = begin; i < end; i++) func(i);
+  });
+}
+
 float rnd() {
   static std::mt19937 gen(0);
   static std::uniform_real_distribution<float> dis(0.f, 1.f);
   return dis(gen);
 }
 
+// Alias table of a discrete distribution, built with Vose's method. A bin
+// picked uniformly keeps its index if a uniform number is below its
+// threshold, and switches to its alias otherwise.
+struct Alias_Table {
+  std::vector<float> threshold, pdf;
+  std::vector<int> alias;
+};
+
+Alias_Table buildAliasTable(const std::vector<float> &weights) {
+  size_t n = weights.size();
+  Alias_Table table;
+  table.threshold.assign(n, 1.f);
+  table.pdf.resize(n);
+  table.alias.resize(n);
+
+  double total = 0.0;
+  for (size_t i = 0; i < n; i++) total += weights[i];
+
+  // bins scaled so the average is 1, split by being under or over it
+  std::vector<double> scaled(n);
+  std::vector<int> small, large;
+  for (size_t i = 0; i < n; i++) {
+    table.pdf[i] = total > 0.0 ? float(weights[i] / total) : 1.f / n;
+    table.alias[i] = (int)i;
+    scaled[i] = total > 0.0 ? weights[i] * n / total : 1.0;
+    (scaled[i] < 1.0 ? small : large).push_back((int)i);
+  }
+
+  // fill each small bin up with a large one
+  while (!small.empty() && !large.empty()) {
+    int s = small.back(), l = large.back();
+    small.pop_back();
+    large.pop_back();
+
+    table.threshold[s] = float(scaled[s]);
+    table.alias[s] = l;
+
+    scaled[l] -= 1.0 - scaled[s];
+    (scaled[l] < 1.0 ? small : large).push_back(l);
+  }
+
+  // leftovers are only off by rounding, they keep their own index
+  return table;
+}
+
 struct Light_Sampler {
   std::vector<Program> sample, pdf;
   std::vector<float3> emissions;
+  std::vector<float> powers;  // emitted power, lights are picked by it
+  std::vector<int> meshLights;  // indices of lights that are only sampled
+
+  // environment map light, its emission is scaled by the map radiance
+  int environment = -1;  // light index, -1 if none
+  Program environmentRadiance;
+
+  // Light selection weights. The environment can't be compared to other
+  // lights by power, so it's picked half of the time instead. Lights are
+  // picked uniformly if some of them have no power.
+  std::vector<float> weights() const {
+    if (powers.size() != emissions.size())
+      return std::vector<float>(emissions.size(), 1.f);
+
+    std::vector<float> result(powers);
+    if (environment >= 0) {
+      float others = 0.f;
+      for (size_t i = 0; i < powers.size(); i++)
+        if ((int)i != environment) others += powers[i];
+
+      result[environment] = others > 0.f ? others : 1.f;
+    }
+
+    return result;
+  }
 };
 
 // returns smallest integer not less than a scalar or each vector component
@@ -1,75 +1,97 @@
 #ifndef IMAGESAVEHPP
 #define IMAGESAVEHPP
 
-#include "gui.hpp"
-
-// Save OptiX output buffer to .PNG file
-int Save_PNG(App_State &app, Buffer &buffer) {
-  unsigned char *arr;
-  arr = (unsigned char *)malloc(app.W * app.H * 3 * sizeof(unsigned char));
-
-  const float4 *cols = (const float4 *)buffer->map();
+#include <vector>
 
-  for (int j = app.H - 1; j >= 0; j--)
-    for (int i = 0; i < app.W; i++) {
-      int index = app.W * j + i;
-      int pixel_index = 3 * (app.W * j + i);
-
-      // average & gamma correct output color
-      float3 col = make_float3(cols[index].x, cols[index].y, cols[index].z);
-      col = sqrt(col / float(app.samples));
-
-      // Clamp and convert to [0, 255]
-      col = 255.99f * clamp(col, 0.f, 1.f);
+#include "gui.hpp"
 
-      // Copy int values to array
-      arr[pixel_index + 0] = (int)col.x;  // R
-      arr[pixel_index + 1] = (int)col.y;  // G
-      arr[pixel_index + 2] = (int)col.z;  // B
+// Converts accumulated colors to the output file format and saves the image.
+// Colors can be written one region at a time, so tiled renders can stream
+// finished tiles out of the device buffers.
+struct Image_Writer {
+  // fileType: PNG = 0, HDR = 1
+  Image_Writer(App_State &app, int fileType) : app(app), fileType(fileType) {
+    if (fileType == 0)
+      png.resize(app.W * app.H * 3);
+    else
+      hdr.resize(app.W * app.H * 3);
+  }
+
+  // Converts a region of accumulated colors, with rows 'pitch' pixels apart,
+  // and stores it at (x, y) of the output image. Rows are expected in the
+  // same top to bottom order as in the acc buffer.
+  void write(const float4 *cols, int pitch, int x, int y, int w, int h) {
+    for (int j = 0; j < h; j++)
+      for (int i = 0; i < w; i++) {
+        int index = pitch * j + i;
+        int pixel_index = 3 * (app.W * (y + j) + (x + i));
+
+        // average output color, alpha holds the number of samples
+        float4 acc = cols[index];
+        float3 col = make_float3(acc.x, acc.y, acc.z) / ffmax(acc.w, 1.f);
+
+        if (fileType == 0) {
+          // gamma correct output color
+          col = sqrt(col);
+
+          // Clamp and convert to [0, 255]
+          col = 255.99f * clamp(col, 0.f, 1.f);
+
+          // Copy int values to array
+          png[pixel_index + 0] = (int)col.x;  // R
+          png[pixel_index + 1] = (int)col.y;  // G
+          png[pixel_index + 2] = (int)col.z;  // B
+        } else {
+          // Apply Reinhard style tone mapping
+          // Eq (3) from 'Photographic Tone Reproduction for Digital Images'
+          // http://citeseerx.ist.psu.edu/viewdoc/download?doi=10.1.1.164.483&rep=rep1&type=pdf
+          col = col / (make_float3(1.f) + col);
+
+          hdr[pixel_index + 0] = col.x;  // R
+          hdr[pixel_index + 1] = col.y;  // G
+          hdr[pixel_index + 2] = col.z;  // B
+        }
+      }
+  }
+
+  // Converts a whole frame sized buffer
+  void write(Buffer &buffer) {
+    const float4 *cols = (const float4 *)buffer->map();
+    write(cols, app.W, 0, 0, app.W, app.H);
+    buffer->unmap();
+  }
+
+  // Saves the image to disk, adding the file extension to its name
+  int save() {
+    if (fileType == 0) {
+      app.fileName += ".png";
+      const char *name = (char *)app.fileName.c_str();
+      return stbi_write_png(name, app.W, app.H, 3, png.data(), 0);
+    } else {
+      app.fileName += ".hdr";
+      const char *name = (char *)app.fileName.c_str();
+      return stbi_write_hdr(name, app.W, app.H, 3, hdr.data());
     }
+  }
 
-  buffer->unmap();
+  App_State &app;
+  const int fileType;
+  std::vector<unsigned char> png;
+  std::vector<float> hdr;
+};
 
-  // Save .PNG file
-  app.fileName += ".png";
-  const char *name = (char *)app.fileName.c_str();
-  return stbi_write_png(name, app.W, app.H, 3, arr, 0);
+// Save OptiX output buffer to .PNG file
+int Save_PNG(App_State &app, Buffer &buffer) {
+  Image_Writer writer(app, 0);
+  writer.write(buffer);
+  return writer.save();
 }
 
 // Save OptiX output buffer to .HDR file
 int Save_HDR(App_State &app, Buffer &buffer) {
-  float *arr;
-  arr = (float *)malloc(app.W * app.H * 3 * sizeof(float));
-
-  const float4 *cols = (const float4 *)buffer->map();
-
-  for (int j = app.W - 1; j >= 0; j--)
-    for (int i = 0; i < app.W; i++) {
-      int index = app.W * j + i;
-      int pixel_index = 3 * (app.W * j + i);
-
-      // average output color
-      float3 col = make_float3(cols[index].x, cols[index].y, cols[index].z);
-      col = col / float(app.samples);
-
-      // Apply Reinhard style tone mapping
-      // Eq (3) from 'Photographic Tone Reproduction for Digital Images'
-      // http://citeseerx.ist.psu.edu/viewdoc/download?doi=10.1.1.164.483&rep=rep1&type=pdf
-      col = col / (make_float3(1.f) + col);
-
-      arr[pixel_index + 0] = col.x;  // R
-      arr[pixel_index + 1] = col.y;  // G
-      arr[pixel_index + 2] = col.z;  // B
-    }
-
-  buffer->unmap();
-
-  // Save .HDR file
-  app.fileName += ".hdr";
-  const char *name = (char *)app.fileName.c_str();
-  return stbi_write_hdr(name, app.W, app.H, 3, arr);
-
-  return 0;
+  Image_Writer writer(app, 1);
+  writer.write(buffer);
+  return writer.save();
 }
 
 #endif
\ No newline at end of file
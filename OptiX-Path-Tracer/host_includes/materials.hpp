@@ -25,15 +25,31 @@ extern "C" const char Hit_PTX[];
 
 // Creates base Host Material class
 struct BRDF {
-  virtual Material assignTo(Context &g_context) const = 0;
+  // Returns the device material. Materials with the same parameters share a
+  // single Material object.
+  Material assignTo(Context &g_context) const {
+    static std::map<std::pair<RTcontext, std::string>, Material> cache;
+    return getShared(cache, key(), g_context,
+                     [&]() { return create(g_context); });
+  }
+
+  // Creates a new device material
+  virtual Material create(Context &g_context) const = 0;
+
+  // Identifies the material by its parameters, empty if it can't be shared
+  virtual std::string key() const { return ""; }
 
-  // Creates device material object
-  static Material createMaterial(Program &closest,      // cloests hit program
-                                 Program &any,          // any hit program
+  // Constant radiance emitted by the material, black if it isn't a light
+  virtual float3 emission() const { return make_float3(0.f); }
+
+  // Creates device material object. Parameters are set as variables of the
+  // material, so every material of a type shares the same hit programs.
+  static Material createMaterial(const char closest[],  // closest hit PTX
                                  Context &g_context) {  // context object
     Material mat = g_context->createMaterial();
-    mat->setClosestHitProgram(0, closest);
-    mat->setAnyHitProgram(1, any);
+    mat->setClosestHitProgram(0, getProgram(closest, "closest_hit", g_context));
+    mat->setAnyHitProgram(1, getProgram(Hit_PTX, "any_hit", g_context));
+    mat["is_light"]->setInt(false);
 
     return mat;
   }
@@ -44,14 +60,16 @@ struct Lambertian : public BRDF {
   Lambertian(const Texture *t) : texture(t) {}
 
   // Assign host side Lambertian material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables and textures
-    Program hit = createProgram(Lambertian_PTX, "closest_hit", g_context);
-    hit["sample_texture"]->setProgramId(texture->assignTo(g_context));
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables and textures
+    Material mat = createMaterial(Lambertian_PTX, g_context);
+    mat["sample_texture"]->setProgramId(texture->assignTo(g_context));
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
+    return mat;
+  }
 
-    return createMaterial(hit, any, g_context);
+  virtual std::string key() const override {
+    return Param_Key("lambertian") << texture->key();
   }
 
   const Texture *texture;
@@ -62,15 +80,17 @@ struct Metal : public BRDF {
   Metal(const Texture *t, const float fuzz) : texture(t), fuzz(fuzz) {}
 
   // Assign host side Metal material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables and textures
-    Program hit = createProgram(Metal_PTX, "closest_hit", g_context);
-    hit["sample_texture"]->setProgramId(texture->assignTo(g_context));
-    hit["fuzz"]->setFloat(fuzz);
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables and textures
+    Material mat = createMaterial(Metal_PTX, g_context);
+    mat["sample_texture"]->setProgramId(texture->assignTo(g_context));
+    mat["fuzz"]->setFloat(fuzz);
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
+    return mat;
+  }
 
-    return createMaterial(hit, any, g_context);
+  virtual std::string key() const override {
+    return Param_Key("metal") << texture->key() << fuzz;
   }
 
   const Texture *texture;
@@ -84,17 +104,20 @@ struct Dielectric : public BRDF {
       : baseTex(baseTex), extTex(extTex), ref_idx(ref_idx), density(density) {}
 
   // Assign host side Dielectric material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables and textures
-    Program hit = createProgram(Dielectric_PTX, "closest_hit", g_context);
-    hit["base_texture"]->setProgramId(baseTex->assignTo(g_context));
-    hit["extinction_texture"]->setProgramId(extTex->assignTo(g_context));
-    hit["ref_idx"]->setFloat(ref_idx);
-    hit["density"]->setFloat(density);
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables and textures
+    Material mat = createMaterial(Dielectric_PTX, g_context);
+    mat["base_texture"]->setProgramId(baseTex->assignTo(g_context));
+    mat["extinction_texture"]->setProgramId(extTex->assignTo(g_context));
+    mat["ref_idx"]->setFloat(ref_idx);
+    mat["density"]->setFloat(density);
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
+    return mat;
+  }
 
-    return createMaterial(hit, any, g_context);
+  virtual std::string key() const override {
+    return Param_Key("dielectric") << baseTex->key() << extTex->key()
+                                   << ref_idx << density;
   }
 
   const Texture *baseTex, *extTex;
@@ -107,15 +130,24 @@ struct Diffuse_Light : public BRDF {
   Diffuse_Light(const Texture *t) : texture(t) {}
 
   // Assign host side Diffuse Light material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables and textures
-    Program hit = createProgram(Light_PTX, "closest_hit", g_context);
-    hit["sample_texture"]->setProgramId(texture->assignTo(g_context));
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables and textures
+    Material mat = createMaterial(Light_PTX, g_context);
+    mat["sample_texture"]->setProgramId(texture->assignTo(g_context));
+    mat["is_light"]->setInt(true);
+
+    return mat;
+  }
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
-    any["is_light"]->setInt(true);
+  virtual std::string key() const override {
+    return Param_Key("diffuse light") << texture->key();
+  }
 
-    return createMaterial(hit, any, g_context);
+  // Textured lights have no constant emission to sample them with
+  virtual float3 emission() const override {
+    const Constant_Texture *color =
+        dynamic_cast<const Constant_Texture *>(texture);
+    return color ? color->color : make_float3(0.f);
   }
 
   const Texture *texture;
@@ -126,14 +158,16 @@ struct Isotropic : public BRDF {
   Isotropic(const Texture *t) : texture(t) {}
 
   // Assign host side Isotropic material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables and textures
-    Program hit = createProgram(Isotropic_PTX, "closest_hit", g_context);
-    hit["sample_texture"]->setProgramId(texture->assignTo(g_context));
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables and textures
+    Material mat = createMaterial(Isotropic_PTX, g_context);
+    mat["sample_texture"]->setProgramId(texture->assignTo(g_context));
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
+    return mat;
+  }
 
-    return createMaterial(hit, any, g_context);
+  virtual std::string key() const override {
+    return Param_Key("isotropic") << texture->key();
   }
 
   const Texture *texture;
@@ -145,14 +179,16 @@ struct Normal_Shader : public BRDF {
       : useShadingNormal(useShadingNormal) {}
 
   // Assign host side Normal Shader material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables
-    Program hit = createProgram(Normal_PTX, "closest_hit", g_context);
-    hit["useShadingNormal"]->setInt(useShadingNormal);
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables
+    Material mat = createMaterial(Normal_PTX, g_context);
+    mat["useShadingNormal"]->setInt(useShadingNormal);
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
+    return mat;
+  }
 
-    return createMaterial(hit, any, g_context);
+  virtual std::string key() const override {
+    return Param_Key("normal") << int(useShadingNormal);
   }
 
   const bool useShadingNormal;
@@ -165,17 +201,20 @@ struct Ashikhmin_Shirley : public BRDF {
       : diffuse_tex(diffuse_tex), specular_tex(specular_tex), nu(nu), nv(nv) {}
 
   // Assign host side Anisotropic material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables and textures
-    Program hit = createProgram(Ashikhmin_PTX, "closest_hit", g_context);
-    hit["diffuse_color"]->setProgramId(diffuse_tex->assignTo(g_context));
-    hit["specular_color"]->setProgramId(specular_tex->assignTo(g_context));
-    hit["nu"]->setFloat(fmaxf(1.f, nu));
-    hit["nv"]->setFloat(fmaxf(1.f, nv));
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables and textures
+    Material mat = createMaterial(Ashikhmin_PTX, g_context);
+    mat["diffuse_color"]->setProgramId(diffuse_tex->assignTo(g_context));
+    mat["specular_color"]->setProgramId(specular_tex->assignTo(g_context));
+    mat["nu"]->setFloat(fmaxf(1.f, nu));
+    mat["nv"]->setFloat(fmaxf(1.f, nv));
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
+    return mat;
+  }
 
-    return createMaterial(hit, any, g_context);
+  virtual std::string key() const override {
+    return Param_Key("ashikhmin shirley") << diffuse_tex->key()
+                                          << specular_tex->key() << nu << nv;
   }
 
   float roughnessToAlpha(float roughness) const {
@@ -198,16 +237,18 @@ struct Oren_Nayar : public BRDF {
   }
 
   // Assign host side Oren-Nayar material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables and textures
-    Program hit = createProgram(Oren_Nayar_PTX, "closest_hit", g_context);
-    hit["sample_texture"]->setProgramId(texture->assignTo(g_context));
-    hit["rA"]->setFloat(rA);
-    hit["rB"]->setFloat(rB);
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables and textures
+    Material mat = createMaterial(Oren_Nayar_PTX, g_context);
+    mat["sample_texture"]->setProgramId(texture->assignTo(g_context));
+    mat["rA"]->setFloat(rA);
+    mat["rB"]->setFloat(rB);
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
+    return mat;
+  }
 
-    return createMaterial(hit, any, g_context);
+  virtual std::string key() const override {
+    return Param_Key("oren nayar") << texture->key() << rA << rB;
   }
 
   const Texture *texture;
@@ -220,16 +261,18 @@ struct Torrance_Sparrow : public BRDF {
       : texture(texture), nu(nu), nv(nv) {}
 
   // Assign host side Torrance-Sparrow material to device Material object
-  virtual Material assignTo(Context &g_context) const override {
-    // Creates closest hit programs and assigns variables and textures
-    Program hit = createProgram(Torrance_PTX, "closest_hit", g_context);
-    hit["sample_texture"]->setProgramId(texture->assignTo(g_context));
-    hit["nu"]->setFloat(roughnessToAlpha(nu));
-    hit["nv"]->setFloat(roughnessToAlpha(nv));
+  virtual Material create(Context &g_context) const override {
+    // Creates material and assigns variables and textures
+    Material mat = createMaterial(Torrance_PTX, g_context);
+    mat["sample_texture"]->setProgramId(texture->assignTo(g_context));
+    mat["nu"]->setFloat(roughnessToAlpha(nu));
+    mat["nv"]->setFloat(roughnessToAlpha(nv));
 
-    Program any = createProgram(Hit_PTX, "any_hit", g_context);
+    return mat;
+  }
 
-    return createMaterial(hit, any, g_context);
+  virtual std::string key() const override {
+    return Param_Key("torrance sparrow") << texture->key() << nu << nv;
   }
 
   float roughnessToAlpha(float roughness) const {
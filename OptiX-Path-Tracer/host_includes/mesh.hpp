@@ -2,10 +2,12 @@
 #define MESHH
 
 #include "hitables.hpp"
-
-#include "../lib/tiny_obj_loader.h"
+#include "mesh_cache.hpp"
+#include "obj_loader.hpp"
+#include "pdfs.hpp"
 
 #include <map>
+#include <unordered_map>
 
 extern "C" const char Mesh_PTX[];
 extern "C" const char Old_Mesh_PTX[];
@@ -15,6 +17,37 @@ extern "C" const char Old_Mesh_PTX[];
 // - File and material conversion from syoyo's tinyobj example:
 // https://github.com/syoyo/tinyobjloader/tree/master/examples/viewer
 
+// OBJ index triple, identifies a vertex shared between faces
+struct Vertex_Key {
+  int v, n, t;  // vertex, normal and texcoord indices
+
+  bool operator==(const Vertex_Key &o) const {
+    return v == o.v && n == o.n && t == o.t;
+  }
+};
+
+struct Vertex_Key_Hash {
+  size_t operator()(const Vertex_Key &k) const {
+    size_t h = std::hash<int>()(k.v);
+    h = h * 31 + std::hash<int>()(k.n);
+    return h * 31 + std::hash<int>()(k.t);
+  }
+};
+
+typedef std::unordered_map<Vertex_Key, unsigned int, Vertex_Key_Hash>
+    Vertex_Map;
+
+// Faces welded together by each conversion thread
+const size_t WELD_BLOCK_SIZE = 1 << 16;
+
+// Vectors filled by the OBJ parser
+struct Mesh_Data {
+  std::vector<int> mat_vector;             // material index vector
+  std::vector<uint3> i_vector;             // face index vector
+  std::vector<float2> t_vector;            // texcoord vector
+  std::vector<float3> v_vector, n_vector;  // vertex and normal vector
+};
+
 // Parse and convert OBJ file
 class Mesh {
   // - If no assets folder is given as parameter, model is in CWD.
@@ -45,53 +78,134 @@ class Mesh {
         givenMaterial(givenMaterial),
         RTX_MODE(RTX) {}
 
-  // Get GeometryInstance of Mesh
+  // Get GeometryInstance of Mesh, converted once and shared by all instances
   GeometryInstance getGeometryInstance(Context &g_context) {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn;
-    std::string err;
+    if (!sharedInstance || owner != g_context->get()) {
+      sharedInstance = createGeometryInstance(g_context);
+      sharedGroup = GeometryGroup();
+      owner = g_context->get();
+    }
 
-    // load obj & mtl files
-    bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-                                (assetsFolder + fileName).c_str(),
-                                assetsFolder.c_str(), true);
+    return sharedInstance;
+  }
 
-    // Check if there was a warning while reading the file
-    if (!warn.empty()) std::cout << "WARN: " << warn << std::endl;
+  // Get GeometryGroup of Mesh. Its acceleration structure is built once, and
+  // every instance of the mesh is a Transform over it.
+  GeometryGroup getGeometryGroup(Context &g_context) {
+    GeometryInstance instance = getGeometryInstance(g_context);
 
-    // Check if there was an error while reading the file
-    if (!err.empty()) std::cerr << "ERR: " << err << std::endl;
+    if (!sharedGroup) {
+      sharedGroup = g_context->createGeometryGroup();
+      sharedGroup->setAcceleration(g_context->createAcceleration("Trbvh"));
+      sharedGroup->addChild(instance);
+    }
 
-    // If file wasn't read successfully, close
-    if (!ret) {
-      printf("Failed to load/parse .obj.");
-      system("PAUSE");
-      exit(0);
+    return sharedGroup;
+  }
+
+  // Apply a rotation to the hitable
+  void rotate(float angle, AXIS axis) {
+    TransformParameter param(Rotate_Transform,   // Transform type
+                             angle,              // Rotation Angle
+                             axis,               // Rotation Axis
+                             make_float3(0.f),   // Scale value
+                             make_float3(0.f));  // Translation delta
+    arr.push_back(param);
+  }
+
+  // Apply a scale to the hitable
+  void scale(float3 scale) {
+    TransformParameter param(Scale_Transform,    // Transform type
+                             0.f,                // Rotation Angle
+                             X_AXIS,             // Rotation Axis
+                             scale,              // Scale value
+                             make_float3(0.f));  // Translation delta
+    arr.push_back(param);
+  }
+
+  // Apply a translation to the hitable
+  void translate(float3 pos) {
+    TransformParameter param(Translate_Transform,  // Transform type
+                             0.f,                  // Rotation Angle
+                             X_AXIS,               // Rotation Axis
+                             make_float3(0.f),     // Scale value
+                             pos);                 // Translation delta
+    arr.push_back(param);
+  }
+
+  // Adds Mesh to the scene graph, with its own transforms
+  void addTo(Group &d_world, Context &g_context,
+             Light_Sampler *lights = nullptr) {
+    addInstanceTo(d_world, g_context, std::vector<TransformParameter>(),
+                  lights);
+  }
+
+  // Adds an instance of the Mesh to the scene graph. The Mesh transforms are
+  // applied first, followed by the instance ones. Instances share the
+  // Mesh's buffers and acceleration structure. If a light sampler is given
+  // and the Mesh material is an emitter, the instance is also added to it
+  // as a light.
+  void addInstanceTo(Group &d_world, Context &g_context,
+                     const std::vector<TransformParameter> &instance,
+                     Light_Sampler *lights = nullptr) {
+    std::vector<TransformParameter> params(arr);
+    params.insert(params.end(), instance.begin(), instance.end());
+
+    // transforms are applied from the back of the vector
+    std::reverse(params.begin(), params.end());
+    addAndTransform(getGeometryGroup(g_context), d_world, g_context, params);
+
+    if (lights && !emitters.empty()) addLightTo(*lights, g_context, params);
+  }
+
+ private:
+  // Adds the emissive triangles, moved to world space, as a light
+  void addLightTo(Light_Sampler &lights, Context &g_context,
+                  const std::vector<TransformParameter> &params) {
+    Matrix4x4 matrix = composeTransforms(params);
+
+    std::vector<float3> vertices(emitters.size());
+    for (size_t i = 0; i < emitters.size(); i++)
+      vertices[i] = make_float3(matrix * make_float4(emitters[i], 1.f));
+
+    lights.meshLights.push_back((int)lights.emissions.size());
+    addLight(lights, Mesh_Light_PDF(vertices), givenMaterial->emission(),
+             g_context);
+  }
+
+  // Converts the mesh and creates its GeometryInstance
+  GeometryInstance createGeometryInstance(Context &g_context) {
+    // converted meshes are cached next to the OBJ file, keyed by its
+    // contents and by whether the MTL materials are used
+    uint32_t options = givenMaterial ? MESH_GIVEN_MATERIAL : 0;
+    Mesh_Cache cache(assetsFolder + fileName, assetsFolder, options);
+
+    // view points either to the mapped cache or to the parsed vectors
+    Mesh_View view;
+    Mesh_Data data;
+    if (cache.load(view))
+      printf("%s: %d faces, %d vertices(cached)\n", fileName.c_str(),
+             (int)view.n_faces, (int)view.n_vertices);
+    else {
+      parse_OBJ(data, view);
+
+      if (!cache.save(view))
+        printf("Couldn't save mesh cache of '%s'.\n", fileName.c_str());
     }
 
     // Convert Materials from MTL file
-    std::map<std::string, int> material_map;  // [Name, index] map
     BRDF *host_material;
     if (givenMaterial == nullptr) {
       Texture_List textures;
 
-      // for each material in the MTL file
-      for (int m = 0; m < materials.size(); m++) {
-        tinyobj::material_t *mp = &materials[m];
+      for (int m = 0; m < (int)view.materials.size(); m++) {
+        const Mesh_Material &mat = view.materials[m];
 
         // Create Texture from image file or color value
-        Texture *tex;
-        if (mp->diffuse_texname.length() > 0)
-          tex = new Image_Texture(assetsFolder + mp->diffuse_texname);
+        if (mat.texture.length() > 0)
+          textures.push(new Image_Texture(assetsFolder + mat.texture));
         else
-          tex = new Constant_Texture(mp->ambient[0],   // R
-                                     mp->ambient[1],   // G
-                                     mp->ambient[2]);  // B
-
-        // Assign texture index to the Material's name
-        material_map[mp->name] = textures.push(tex);
+          textures.push(new Constant_Texture(mat.color));
       }
 
       // Create a vector of textures
@@ -101,50 +215,14 @@ class Mesh {
       host_material = givenMaterial;
     }
 
-    // Convert Geoemtry
-    std::vector<int> mat_vector;             // material index vector
-    std::vector<uint3> i_vector;             // face index vector
-    std::vector<float2> t_vector;            // texcoord vector
-    std::vector<float3> v_vector, n_vector;  // vertex and normal vector
-
-    int index = 0, n_faces = 0;
-    std::vector<tinyobj::shape_t>::const_iterator it;
-    for (it = shapes.begin(); it < shapes.end(); ++it) {
-      const tinyobj::shape_t &shape = *it;
-
-      // for each face of the current mesh
-      for (size_t f = 0; f < shape.mesh.indices.size() / 3; f++) {
-        // Get the three indexes of the face (all faces are triangular)
-        tinyobj::index_t idx0 = shape.mesh.indices[3 * f + 0];
-        tinyobj::index_t idx1 = shape.mesh.indices[3 * f + 1];
-        tinyobj::index_t idx2 = shape.mesh.indices[3 * f + 2];
-
-        // get the vertex coordinates
-        make_Vertex3(v_vector, attrib.vertices, idx0.vertex_index);
-        make_Vertex3(v_vector, attrib.vertices, idx1.vertex_index);
-        make_Vertex3(v_vector, attrib.vertices, idx2.vertex_index);
-
-        // get the normal coordinates
-        make_Vertex3(n_vector, attrib.normals, idx0.normal_index);
-        make_Vertex3(n_vector, attrib.normals, idx1.normal_index);
-        make_Vertex3(n_vector, attrib.normals, idx2.normal_index);
-
-        // get the vertex tex coordinates
-        make_Vertex2(t_vector, attrib.texcoords, idx0.texcoord_index);
-        make_Vertex2(t_vector, attrib.texcoords, idx1.texcoord_index);
-        make_Vertex2(t_vector, attrib.texcoords, idx2.texcoord_index);
-
-        // set index vector
-        i_vector.push_back(make_uint3(index++, index++, index++));
-
-        // set material index vector
-        if (givenMaterial == nullptr) {
-          int m = material_map[materials[shape.mesh.material_ids[f]].name];
-          mat_vector.push_back(m);
-        } else
-          mat_vector.push_back(0);  // uses the material given as parameter
-
-        n_faces++;
+    // emitters keep a copy of their triangles to be sampled as lights
+    emitters.clear();
+    if (givenMaterial && !isNull(givenMaterial->emission())) {
+      emitters.resize(view.n_faces * 3);
+      for (size_t i = 0; i < view.n_faces; i++) {
+        emitters[3 * i + 0] = view.vertices[view.faces[i].x];
+        emitters[3 * i + 1] = view.vertices[view.faces[i].y];
+        emitters[3 * i + 2] = view.vertices[view.faces[i].z];
       }
     }
 
@@ -152,14 +230,16 @@ class Mesh {
     GeometryInstance gi = g_context->createGeometryInstance();
 
     // Create Geometry parameters callable program
-    Program prog = createProgram(Triangle_PTX, "Get_HitRecord", g_context);
+    Program prog = getProgram(Triangle_PTX, "Get_HitRecord", g_context);
 
     // create and set buffers
-    Buffer v_buffer = createBuffer(v_vector, g_context);
-    Buffer n_buffer = createBuffer(n_vector, g_context);
-    Buffer t_buffer = createBuffer(t_vector, g_context);
-    Buffer i_buffer = createBuffer(i_vector, g_context);
-    Buffer m_buffer = createBuffer(mat_vector, g_context);
+    Buffer v_buffer = createBuffer(view.vertices, view.n_vertices, g_context);
+    Buffer n_buffer = createBuffer(view.normals, view.n_normals, g_context);
+    Buffer t_buffer =
+        createBuffer(view.texcoords, view.n_texcoords, g_context);
+    Buffer i_buffer = createBuffer(view.faces, view.n_faces, g_context);
+    Buffer m_buffer =
+        createBuffer(view.face_materials, view.n_faces, g_context);
 
     // assign programs and paramters to GeometryInstance
     gi["vertex_buffer"]->setBuffer(v_buffer);
@@ -176,25 +256,25 @@ class Mesh {
     if (RTX_MODE) {
       // Create a GeometryTriangles object
       GeometryTriangles geometry = g_context->createGeometryTriangles();
-      geometry->setPrimitiveCount((int)i_vector.size());
+      geometry->setPrimitiveCount((int)view.n_faces);
       geometry->setTriangleIndices(i_buffer, RT_FORMAT_UNSIGNED_INT3);
-      geometry->setVertices((int)v_vector.size(), v_buffer, RT_FORMAT_FLOAT3);
+      geometry->setVertices((int)view.n_vertices, v_buffer, RT_FORMAT_FLOAT3);
       geometry->setBuildFlags(RTgeometrybuildflags(0));
 
       // Set attribute program
-      Program att = createProgram(Triangle_PTX, "Attributes", g_context);
+      Program att = getProgram(Triangle_PTX, "Attributes", g_context);
       geometry->setAttributeProgram(att);
 
       gi->setGeometryTriangles(geometry);
     } else {
       // Create a Geometry object
       Geometry geometry = g_context->createGeometry();
-      geometry->setPrimitiveCount(n_faces);
+      geometry->setPrimitiveCount((int)view.n_faces);
 
       // Set intersection and bounding box programs
-      Program bound = createProgram(Triangle_PTX, "Get_Bounds", g_context);
+      Program bound = getProgram(Triangle_PTX, "Get_Bounds", g_context);
       geometry->setBoundingBoxProgram(bound);
-      Program inter = createProgram(Triangle_PTX, "Intersect", g_context);
+      Program inter = getProgram(Triangle_PTX, "Intersect", g_context);
       geometry->setIntersectionProgram(inter);
 
       gi->setGeometry(geometry);
@@ -203,7 +283,196 @@ class Mesh {
     return gi;
   }
 
-  // Apply a rotation to the hitable
+  // Parses the OBJ and MTL files, welding shared vertices, and points the
+  // view to the converted vectors
+  void parse_OBJ(Mesh_Data &data, Mesh_View &view) {
+    Obj_Data obj;
+    if (!Load_OBJ(assetsFolder + fileName, assetsFolder, obj)) {
+      printf("Failed to load/parse .obj.");
+      exitOnError();
+    }
+
+    // Convert MTL materials to a table of textures or colors, in the same
+    // order as the material ids of the faces
+    if (givenMaterial == nullptr) {
+      for (int m = 0; m < (int)obj.materials.size(); m++) {
+        const tinyobj::material_t &mp = obj.materials[m];
+
+        Mesh_Material mat;
+        mat.texture = mp.diffuse_texname;
+        mat.color = make_float3(mp.ambient[0],   // R
+                                mp.ambient[1],   // G
+                                mp.ambient[2]);  // B
+        view.materials.push_back(mat);
+      }
+    }
+
+    // Normals and texcoords are indexed like vertices, so every vertex gets
+    // one if any face corner has it
+    bool hasNormals = false, hasTexcoords = false;
+    for (const Obj_Corner &corner : obj.corners) {
+      hasNormals = hasNormals || corner.n >= 0;
+      hasTexcoords = hasTexcoords || corner.t >= 0;
+    }
+
+    // Convert Geoemtry in parallel, in blocks of a fixed number of faces.
+    // Vertices are welded inside each block, so the result doesn't depend on
+    // the number of threads.
+    size_t n_faces = obj.face_materials.size();
+    size_t n_blocks = (n_faces + WELD_BLOCK_SIZE - 1) / WELD_BLOCK_SIZE;
+    std::vector<Mesh_Data> blocks(n_blocks);
+    parallelFor(n_blocks, [&](size_t b) {
+      size_t begin = b * WELD_BLOCK_SIZE;
+      size_t end = std::min(begin + WELD_BLOCK_SIZE, n_faces);
+      convert_Faces(obj, begin, end, hasNormals, hasTexcoords, blocks[b]);
+    });
+
+    // Merge blocks, offsetting their face indices
+    std::vector<size_t> v_offset(n_blocks + 1, 0), n_offset(n_blocks + 1, 0),
+        t_offset(n_blocks + 1, 0);
+    for (size_t b = 0; b < n_blocks; b++) {
+      v_offset[b + 1] = v_offset[b] + blocks[b].v_vector.size();
+      n_offset[b + 1] = n_offset[b] + blocks[b].n_vector.size();
+      t_offset[b + 1] = t_offset[b] + blocks[b].t_vector.size();
+    }
+
+    data.v_vector.resize(v_offset[n_blocks]);
+    data.n_vector.resize(n_offset[n_blocks]);
+    data.t_vector.resize(t_offset[n_blocks]);
+    data.i_vector.resize(n_faces);
+    data.mat_vector.resize(n_faces);
+
+    parallelFor(n_blocks, [&](size_t b) {
+      const Mesh_Data &block = blocks[b];
+      std::copy(block.v_vector.begin(), block.v_vector.end(),
+                data.v_vector.begin() + v_offset[b]);
+      std::copy(block.n_vector.begin(), block.n_vector.end(),
+                data.n_vector.begin() + n_offset[b]);
+      std::copy(block.t_vector.begin(), block.t_vector.end(),
+                data.t_vector.begin() + t_offset[b]);
+      std::copy(block.mat_vector.begin(), block.mat_vector.end(),
+                data.mat_vector.begin() + b * WELD_BLOCK_SIZE);
+
+      unsigned int offset = (unsigned int)v_offset[b];
+      for (size_t f = 0; f < block.i_vector.size(); f++) {
+        uint3 face = block.i_vector[f];
+        data.i_vector[b * WELD_BLOCK_SIZE + f] =
+            make_uint3(face.x + offset, face.y + offset, face.z + offset);
+      }
+    });
+
+    // report memory saved by welding, against one vertex per face corner
+    size_t vertexSize = sizeof(float3);
+    if (!data.n_vector.empty()) vertexSize += sizeof(float3);
+    if (!data.t_vector.empty()) vertexSize += sizeof(float2);
+    size_t welded = data.v_vector.size() * vertexSize;
+    size_t unwelded = 3 * n_faces * vertexSize;
+    printf("%s: %d faces, %d vertices(%.2f MB saved by welding)\n",
+           fileName.c_str(), (int)n_faces, (int)data.v_vector.size(),
+           (unwelded - welded) / (1024.f * 1024.f));
+
+    view.vertices = data.v_vector.data();
+    view.normals = data.n_vector.data();
+    view.texcoords = data.t_vector.data();
+    view.faces = data.i_vector.data();
+    view.face_materials = data.mat_vector.data();
+    view.n_vertices = data.v_vector.size();
+    view.n_normals = data.n_vector.size();
+    view.n_texcoords = data.t_vector.size();
+    view.n_faces = data.i_vector.size();
+  }
+
+  // Converts faces [begin, end) of the OBJ file into the block's vectors
+  void convert_Faces(const Obj_Data &obj, size_t begin, size_t end,
+                     bool hasNormals, bool hasTexcoords, Mesh_Data &block) {
+    // Faces index unique (vertex, normal, texcoord) triples, so vertices
+    // shared between faces are only stored once
+    Vertex_Map vertex_map;
+    vertex_map.reserve(end - begin);
+
+    for (size_t f = begin; f < end; f++) {
+      Obj_Corner corners[3];
+      for (int c = 0; c < 3; c++) {
+        corners[c] = obj.corners[3 * f + c];
+        if (!hasNormals) corners[c].n = -1;
+        if (!hasTexcoords) corners[c].t = -1;
+      }
+
+      // corners without a normal get the face's, so they can't be shared
+      // with other faces
+      float3 faceNormal = make_float3(0.f, 0.f, 1.f);
+      if (hasNormals) {
+        const float3 &a = obj.vertices[corners[0].v];
+        float3 N = cross(obj.vertices[corners[1].v] - a,
+                         obj.vertices[corners[2].v] - a);
+        if (length(N) > 0.f) faceNormal = normalize(N);
+      }
+
+      // set index vector
+      unsigned int idx[3];
+      for (int c = 0; c < 3; c++)
+        idx[c] = weld_Vertex(corners[c], (int)f, faceNormal, obj, hasNormals,
+                             hasTexcoords, vertex_map, block);
+      block.i_vector.push_back(make_uint3(idx[0], idx[1], idx[2]));
+
+      // set material index vector, faces without usemtl get the first one
+      if (givenMaterial == nullptr)
+        block.mat_vector.push_back(std::max(obj.face_materials[f], 0));
+      else
+        block.mat_vector.push_back(0);  // uses the material given as parameter
+    }
+  }
+
+  // Returns the index of the vertex given by an OBJ corner, adding it to the
+  // block's vertex, normal and texcoord vectors if it's new. If the mesh has
+  // normals or texcoords, every vertex gets one, so they stay aligned with
+  // the vertices; missing ones are the face normal and (0, 0).
+  unsigned int weld_Vertex(const Obj_Corner &corner, int face,
+                           const float3 &faceNormal, const Obj_Data &obj,
+                           bool hasNormals, bool hasTexcoords,
+                           Vertex_Map &vertex_map, Mesh_Data &block) {
+    // face normals are keyed by a negative face index, below the -1 used for
+    // no normal
+    int n = (hasNormals && corner.n < 0) ? -2 - face : corner.n;
+    Vertex_Key key = {corner.v, n, corner.t};
+
+    auto it = vertex_map.find(key);
+    if (it != vertex_map.end()) return it->second;
+
+    unsigned int index = (unsigned int)block.v_vector.size();
+    vertex_map[key] = index;
+
+    block.v_vector.push_back(obj.vertices[corner.v]);
+    if (hasNormals)
+      block.n_vector.push_back(corner.n >= 0 ? obj.normals[corner.n]
+                                             : faceNormal);
+    if (hasTexcoords)
+      block.t_vector.push_back(corner.t >= 0 ? obj.texcoords[corner.t]
+                                             : make_float2(0.f, 0.f));
+
+    return index;
+  }
+
+  bool RTX_MODE;
+  BRDF *givenMaterial;
+  const std::string fileName, assetsFolder;
+  std::vector<TransformParameter> arr;
+  std::vector<float3> emitters;  // object space triangles of emissive meshes
+
+  // shared by all instances in the context
+  GeometryInstance sharedInstance;
+  GeometryGroup sharedGroup;
+  RTcontext owner = nullptr;
+};
+
+// Placement of a Mesh in the scene. Instances only add Transform nodes over
+// the Mesh's GeometryGroup, so repeated meshes cost a single copy of the
+// geometry and a single acceleration structure.
+class Mesh_Instance {
+ public:
+  Mesh_Instance(Mesh *mesh) : mesh(mesh) {}
+
+  // Apply a rotation to the instance
   void rotate(float angle, AXIS axis) {
     TransformParameter param(Rotate_Transform,   // Transform type
                              angle,              // Rotation Angle
@@ -213,7 +482,7 @@ class Mesh {
     arr.push_back(param);
   }
 
-  // Apply a scale to the hitable
+  // Apply a scale to the instance
   void scale(float3 scale) {
     TransformParameter param(Scale_Transform,    // Transform type
                              0.f,                // Rotation Angle
@@ -223,7 +492,7 @@ class Mesh {
     arr.push_back(param);
   }
 
-  // Apply a translation to the hitable
+  // Apply a translation to the instance
   void translate(float3 pos) {
     TransformParameter param(Translate_Transform,  // Transform type
                              0.f,                  // Rotation Angle
@@ -233,39 +502,15 @@ class Mesh {
     arr.push_back(param);
   }
 
-  // Adds Hitable to the scene graph
-  void addTo(Group &d_world, Context &g_context) {
-    // reverse vector of transforms
-    std::reverse(arr.begin(), arr.end());
-    GeometryInstance gi = getGeometryInstance(g_context);
-    addAndTransform(gi, d_world, g_context, arr);
+  // Adds the instance to the scene graph, and to the lights if it's an
+  // emitter and a light sampler is given
+  void addTo(Group &d_world, Context &g_context,
+             Light_Sampler *lights = nullptr) {
+    mesh->addInstanceTo(d_world, g_context, arr, lights);
   }
 
  private:
-  // Make a float3 vertex out of a vector and an index
-  void make_Vertex3(std::vector<float3> &vertex_list,
-                    std::vector<tinyobj::real_t> &attribs, int index) {
-    if (index >= 0) {
-      float x = attribs[3 * index + 0];
-      float y = attribs[3 * index + 1];
-      float z = attribs[3 * index + 2];
-      vertex_list.push_back(make_float3(x, y, z));
-    }
-  }
-
-  // Make a float2 vertex out of a vector and an index
-  void make_Vertex2(std::vector<float2> &vertex_list,
-                    std::vector<tinyobj::real_t> &attribs, int index) {
-    if (index >= 0) {
-      float x = attribs[2 * index + 0];
-      float y = attribs[2 * index + 1];
-      vertex_list.push_back(make_float2(x, y));
-    }
-  }
-
-  bool RTX_MODE;
-  BRDF *givenMaterial;
-  const std::string fileName, assetsFolder;
+  Mesh *mesh;
   std::vector<TransformParameter> arr;
 };
 
@@ -324,19 +569,19 @@ class Mesh_List {
     return gg;
   }
 
-  // FIXME: not working
-  // adds and transforms Mesh_List as a whole to the scene graph
-  void addListTo(Group &d_world, Context &g_context) {
-    GeometryGroup gg = getGroup(g_context);
-    addAndTransform(gg, d_world, g_context, arr);
+  // adds and transforms Mesh_List as a whole to the scene graph. Each mesh
+  // keeps its own GeometryGroup, with its transforms followed by the list's.
+  void addListTo(Group &d_world, Context &g_context,
+                 Light_Sampler *lights = nullptr) {
+    for (int i = 0; i < (int)list.size(); i++)
+      list[i]->addInstanceTo(d_world, g_context, arr, lights);
   }
-  // TODO: implement a function that applies the list transforms to the mesh
-  // the mesh should still be added separately
 
   // adds and transforms each list element to the scene graph individually
-  void addElementsTo(Group &d_world, Context &g_context) {
+  void addElementsTo(Group &d_world, Context &g_context,
+                     Light_Sampler *lights = nullptr) {
     for (int i = 0; i < (int)list.size(); i++)
-      list[i]->addTo(d_world, g_context);
+      list[i]->addTo(d_world, g_context, lights);
   }
 
  private:
@@ -0,0 +1,304 @@
+#ifndef MESHCACHEH
+#define MESHCACHEH
+
+// mesh_cache.hpp: Define the binary cache of converted OBJ meshes
+
+#include <stdint.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "host_common.hpp"
+
+// Material of a converted mesh, an MTL diffuse texture or color
+struct Mesh_Material {
+  std::string texture;  // texture file, relative to the assets folder
+  float3 color;         // used if there's no texture
+};
+
+// Converted mesh arrays, ready to be copied to OptiX buffers. They either
+// point to vectors filled by the OBJ parser or to a memory mapped cache.
+struct Mesh_View {
+  const float3 *vertices, *normals;
+  const float2 *texcoords;
+  const uint3 *faces;
+  const int *face_materials;  // material index of each face
+  size_t n_vertices, n_normals, n_texcoords, n_faces;
+  std::vector<Mesh_Material> materials;
+};
+
+// Read only memory mapping of a whole file
+struct Mapped_File {
+  Mapped_File() : data(nullptr), size(0) {}
+  Mapped_File(const Mapped_File &) = delete;
+  Mapped_File &operator=(const Mapped_File &) = delete;
+  ~Mapped_File() { close(); }
+
+  // Maps the file, returns false if it can't be opened
+  bool open(const std::string &path) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = (size_t)fileSize.QuadPart;
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping)
+      data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0,
+                                                  0, 0);
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    fstat(fd, &info);
+    size = (size_t)info.st_size;
+
+    // empty files can't be mapped
+    void *ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) data = (const unsigned char *)ptr;
+#endif
+    if (!data) {
+      close();
+      return false;
+    }
+
+    return true;
+  }
+
+  void close() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (data) munmap((void *)data, size);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+    data = nullptr;
+    size = 0;
+  }
+
+  const unsigned char *data;
+  size_t size;
+
+ private:
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL;
+#else
+  int fd = -1;
+#endif
+};
+
+// 64-bit FNV-1a hash
+uint64_t fnv1a(const unsigned char *data, size_t size,
+               uint64_t hash = 14695981039346656037ull) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 1099511628211ull;
+  }
+
+  return hash;
+}
+
+// Conversion options that change the cached data
+enum Mesh_Cache_Options { MESH_GIVEN_MATERIAL = 1 };
+
+// Cache files start with this header, followed by the vertex, normal,
+// texcoord, face and face material arrays, and then by the material table:
+// each entry holds the texture name length, its characters, and a float3
+// color.
+struct Mesh_Cache_Header {
+  char magic[4];
+  uint32_t version;
+  uint64_t hash;     // hash of the OBJ and MTL files
+  uint32_t options;  // Mesh_Cache_Options flags
+  uint32_t n_vertices, n_normals, n_texcoords, n_faces, n_materials;
+};
+
+const char MESH_CACHE_MAGIC[4] = {'O', 'P', 'T', 'M'};
+const uint32_t MESH_CACHE_VERSION = 4;
+
+// Binary cache of a converted OBJ file, saved next to it. It's keyed by the
+// hash of the OBJ and MTL files and by the conversion options, and memory
+// mapped when loaded, so arrays are copied straight to OptiX buffers.
+class Mesh_Cache {
+ public:
+  Mesh_Cache(const std::string &objPath, const std::string &assetsFolder,
+             uint32_t options)
+      : path(objPath + ".cache"), options(options) {
+    hash = hashFiles(objPath, assetsFolder);
+  }
+
+  // Maps the cache, filling the view if it's valid for the current OBJ file.
+  // The view is valid while the cache object is alive.
+  bool load(Mesh_View &view) {
+    if (!file.open(path)) return false;
+
+    const unsigned char *ptr = file.data;
+    const unsigned char *end = file.data + file.size;
+
+    Mesh_Cache_Header header;
+    if (!read(ptr, end, &header, sizeof(header)) ||
+        memcmp(header.magic, MESH_CACHE_MAGIC, 4) ||
+        header.version != MESH_CACHE_VERSION || header.hash != hash ||
+        header.options != options) {
+      file.close();
+      return false;
+    }
+
+    view.n_vertices = header.n_vertices;
+    view.n_normals = header.n_normals;
+    view.n_texcoords = header.n_texcoords;
+    view.n_faces = header.n_faces;
+    view.vertices = (const float3 *)ptr;
+    ptr += view.n_vertices * sizeof(float3);
+    view.normals = (const float3 *)ptr;
+    ptr += view.n_normals * sizeof(float3);
+    view.texcoords = (const float2 *)ptr;
+    ptr += view.n_texcoords * sizeof(float2);
+    view.faces = (const uint3 *)ptr;
+    ptr += view.n_faces * sizeof(uint3);
+    view.face_materials = (const int *)ptr;
+    ptr += view.n_faces * sizeof(int);
+    if (ptr > end) {
+      file.close();
+      return false;
+    }
+
+    view.materials.resize(header.n_materials);
+    for (uint32_t i = 0; i < header.n_materials; i++) {
+      uint32_t length;
+      if (!read(ptr, end, &length, sizeof(length)) ||
+          ptr + length + sizeof(float3) > end) {
+        file.close();
+        return false;
+      }
+
+      view.materials[i].texture.assign((const char *)ptr, length);
+      ptr += length;
+      read(ptr, end, &view.materials[i].color, sizeof(float3));
+    }
+
+    return true;
+  }
+
+  // Saves a converted mesh. The file is written under a temporary name
+  // first, so a partial write never looks like a valid cache.
+  bool save(const Mesh_View &view) {
+    std::string tempName = path + ".tmp";
+    FILE *out = fopen(tempName.c_str(), "wb");
+    if (!out) return false;
+
+    Mesh_Cache_Header header;
+    memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+    header.version = MESH_CACHE_VERSION;
+    header.hash = hash;
+    header.options = options;
+    header.n_vertices = (uint32_t)view.n_vertices;
+    header.n_normals = (uint32_t)view.n_normals;
+    header.n_texcoords = (uint32_t)view.n_texcoords;
+    header.n_faces = (uint32_t)view.n_faces;
+    header.n_materials = (uint32_t)view.materials.size();
+
+    bool ok = write(out, &header, sizeof(header));
+    ok = ok && write(out, view.vertices, view.n_vertices * sizeof(float3));
+    ok = ok && write(out, view.normals, view.n_normals * sizeof(float3));
+    ok = ok && write(out, view.texcoords, view.n_texcoords * sizeof(float2));
+    ok = ok && write(out, view.faces, view.n_faces * sizeof(uint3));
+    ok = ok && write(out, view.face_materials, view.n_faces * sizeof(int));
+
+    for (size_t i = 0; ok && i < view.materials.size(); i++) {
+      const Mesh_Material &mat = view.materials[i];
+      uint32_t length = (uint32_t)mat.texture.size();
+      ok = write(out, &length, sizeof(length)) &&
+           write(out, mat.texture.data(), length) &&
+           write(out, &mat.color, sizeof(float3));
+    }
+
+    ok = (fclose(out) == 0) && ok;
+    if (!ok) {
+      remove(tempName.c_str());
+      return false;
+    }
+
+    // rename doesn't replace existing files on Windows
+    remove(path.c_str());
+    return rename(tempName.c_str(), path.c_str()) == 0;
+  }
+
+ private:
+  // Hashes the OBJ file and the MTL files it references
+  static uint64_t hashFiles(const std::string &objPath,
+                            const std::string &assetsFolder) {
+    Mapped_File obj;
+    if (!obj.open(objPath)) return 0;
+
+    uint64_t hash = fnv1a(obj.data, obj.size);
+
+    const char *begin = (const char *)obj.data;
+    const char *end = begin + obj.size;
+    const char tag[] = "mtllib";
+    const char *it = std::search(begin, end, tag, tag + 6);
+    while (it != end) {
+      // the line lists MTL file names separated by spaces
+      const char *name = it + 6;
+      while (true) {
+        while (name < end && (*name == ' ' || *name == '\t')) name++;
+        const char *nameEnd = name;
+        while (nameEnd < end && !isspace((unsigned char)*nameEnd)) nameEnd++;
+        if (nameEnd == name) break;
+
+        Mapped_File mtl;
+        if (mtl.open(assetsFolder + std::string(name, nameEnd)))
+          hash = fnv1a(mtl.data, mtl.size, hash);
+
+        name = nameEnd;
+      }
+
+      it = std::search(name, end, tag, tag + 6);
+    }
+
+    return hash;
+  }
+
+  static bool read(const unsigned char *&ptr, const unsigned char *end,
+                   void *dst, size_t size) {
+    if (ptr + size > end) return false;
+    memcpy(dst, ptr, size);
+    ptr += size;
+    return true;
+  }
+
+  static bool write(FILE *out, const void *src, size_t size) {
+    return size == 0 || fwrite(src, size, 1, out) == 1;
+  }
+
+  const std::string path;
+  const uint32_t options;
+  uint64_t hash;
+  Mapped_File file;
+};
+
+#endif
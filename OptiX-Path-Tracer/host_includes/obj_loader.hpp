@@ -0,0 +1,351 @@
+#ifndef OBJLOADERH
+#define OBJLOADERH
+
+// obj_loader.hpp: Define a multithreaded OBJ file parser
+
+#include <cctype>
+#include <cstdlib>
+
+#include "../lib/tiny_obj_loader.h"
+
+#include "mesh_cache.hpp"
+
+// Sources:
+// - MTL parsing is left to syoyo's tinyobjloader, since MTL files are small:
+// https://github.com/syoyo/tinyobjloader
+
+// Triangle corner, 0-based indices or -1 if the attribute is missing
+struct Obj_Corner {
+  int v, t, n;  // vertex, texcoord and normal indices
+};
+
+// Parsed OBJ file
+struct Obj_Data {
+  std::vector<float3> vertices, normals;
+  std::vector<float2> texcoords;
+  std::vector<Obj_Corner> corners;  // three per triangle
+  std::vector<int> face_materials;  // MTL material id of each triangle
+  std::vector<tinyobj::material_t> materials;
+};
+
+// Data parsed from a line aligned chunk of an OBJ file. Indices are kept as
+// written in the file, since relative ones depend on the previous chunks.
+struct Obj_Chunk {
+  std::vector<float3> vertices, normals;
+  std::vector<float2> texcoords;
+
+  // corners hold raw OBJ indices, 0 if missing; a relative index is turned
+  // into a chunk local position and flagged in 'relative' (bit 0 vertex,
+  // bit 1 texcoord, bit 2 normal)
+  std::vector<Obj_Corner> corners;
+  std::vector<unsigned char> relative;
+
+  // triangles refer to a usemtl statement of this chunk, or -1 if they use
+  // the material of the previous chunks
+  std::vector<int> face_usemtl;
+  std::vector<std::string> usemtl, mtllibs;
+};
+
+// Parses a float, moving ptr past it. The token is copied out of the file,
+// since strtof needs a terminated string, and strtof rounds it correctly.
+float parse_Float(const char *&ptr, const char *end) {
+  char token[64];
+  size_t length = 0;
+  while (ptr + length < end && length + 1 < sizeof(token) &&
+         !isspace((unsigned char)ptr[length])) {
+    token[length] = ptr[length];
+    length++;
+  }
+  token[length] = '\0';
+
+  char *parsed;
+  float value = strtof(token, &parsed);
+  ptr += parsed - token;
+
+  return value;
+}
+
+// Parses an int, moving ptr past it. Returns 0 if there's no number.
+int parse_Int(const char *&ptr, const char *end) {
+  bool negative = false;
+  if (ptr < end && (*ptr == '-' || *ptr == '+')) negative = (*ptr++ == '-');
+
+  int value = 0;
+  while (ptr < end && *ptr >= '0' && *ptr <= '9')
+    value = value * 10 + (*ptr++ - '0');
+
+  return negative ? -value : value;
+}
+
+void skip_Spaces(const char *&ptr, const char *end) {
+  while (ptr < end && (*ptr == ' ' || *ptr == '\t')) ptr++;
+}
+
+bool is_Token(const char *ptr, const char *end, const char *token) {
+  size_t length = strlen(token);
+  if (size_t(end - ptr) <= length) return false;
+  return !strncmp(ptr, token, length) &&
+         (ptr[length] == ' ' || ptr[length] == '\t');
+}
+
+// Returns the rest of the line, without surrounding spaces
+std::string parse_Name(const char *ptr, const char *end) {
+  skip_Spaces(ptr, end);
+  while (end > ptr && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+    end--;
+  return std::string(ptr, end);
+}
+
+// Splits the rest of the line into names separated by spaces
+void parse_Names(const char *ptr, const char *end,
+                 std::vector<std::string> &names) {
+  while (true) {
+    skip_Spaces(ptr, end);
+    const char *name = ptr;
+    while (ptr < end && !isspace((unsigned char)*ptr)) ptr++;
+    if (ptr == name) return;
+
+    names.push_back(std::string(name, ptr));
+  }
+}
+
+// Parses a face corner, in the 'v', 'v/t', 'v//n' or 'v/t/n' formats
+void parse_Corner(const char *&ptr, const char *end, Obj_Chunk &chunk,
+                  Obj_Corner &corner, unsigned char &relative) {
+  corner.v = parse_Int(ptr, end);
+  corner.t = corner.n = 0;
+
+  if (ptr < end && *ptr == '/') {
+    ptr++;
+    corner.t = parse_Int(ptr, end);
+
+    if (ptr < end && *ptr == '/') {
+      ptr++;
+      corner.n = parse_Int(ptr, end);
+    }
+  }
+
+  // relative indices count back from the vertices read so far
+  relative = 0;
+  if (corner.v < 0) {
+    corner.v += (int)chunk.vertices.size();
+    relative |= 1;
+  }
+  if (corner.t < 0) {
+    corner.t += (int)chunk.texcoords.size();
+    relative |= 2;
+  }
+  if (corner.n < 0) {
+    corner.n += (int)chunk.normals.size();
+    relative |= 4;
+  }
+}
+
+// Parses a single line into the chunk
+void parse_Line(const char *ptr, const char *end, Obj_Chunk &chunk) {
+  skip_Spaces(ptr, end);
+  if (ptr >= end) return;
+
+  if (is_Token(ptr, end, "v")) {
+    ptr += 1;
+    skip_Spaces(ptr, end);
+    float x = parse_Float(ptr, end);
+    skip_Spaces(ptr, end);
+    float y = parse_Float(ptr, end);
+    skip_Spaces(ptr, end);
+    float z = parse_Float(ptr, end);
+    chunk.vertices.push_back(make_float3(x, y, z));
+  }
+
+  else if (is_Token(ptr, end, "vn")) {
+    ptr += 2;
+    skip_Spaces(ptr, end);
+    float x = parse_Float(ptr, end);
+    skip_Spaces(ptr, end);
+    float y = parse_Float(ptr, end);
+    skip_Spaces(ptr, end);
+    float z = parse_Float(ptr, end);
+    chunk.normals.push_back(make_float3(x, y, z));
+  }
+
+  else if (is_Token(ptr, end, "vt")) {
+    ptr += 2;
+    skip_Spaces(ptr, end);
+    float x = parse_Float(ptr, end);
+    skip_Spaces(ptr, end);
+    float y = parse_Float(ptr, end);
+    chunk.texcoords.push_back(make_float2(x, y));
+  }
+
+  else if (is_Token(ptr, end, "f")) {
+    ptr += 1;
+    Obj_Corner first = {0, 0, 0}, previous = first, corner = first;
+    unsigned char firstRel = 0, previousRel = 0, cornerRel = 0;
+    int count = 0;
+
+    // polygons are triangulated as a fan around the first corner
+    while (true) {
+      skip_Spaces(ptr, end);
+      if (ptr >= end || *ptr == '\r' || *ptr == '#') break;
+
+      const char *start = ptr;
+      parse_Corner(ptr, end, chunk, corner, cornerRel);
+      if (ptr == start) break;  // not a number
+
+      if (count == 0) {
+        first = corner;
+        firstRel = cornerRel;
+      } else if (count >= 2) {
+        chunk.corners.push_back(first);
+        chunk.corners.push_back(previous);
+        chunk.corners.push_back(corner);
+        chunk.relative.push_back(firstRel);
+        chunk.relative.push_back(previousRel);
+        chunk.relative.push_back(cornerRel);
+        chunk.face_usemtl.push_back((int)chunk.usemtl.size() - 1);
+      }
+
+      previous = corner;
+      previousRel = cornerRel;
+      count++;
+    }
+  }
+
+  else if (is_Token(ptr, end, "usemtl"))
+    chunk.usemtl.push_back(parse_Name(ptr + 6, end));
+
+  // a single mtllib line can list several files
+  else if (is_Token(ptr, end, "mtllib"))
+    parse_Names(ptr + 6, end, chunk.mtllibs);
+}
+
+// Parses the lines in [begin, end)
+void parse_Chunk(const char *begin, const char *end, Obj_Chunk &chunk) {
+  const char *line = begin;
+  while (line < end) {
+    const char *lineEnd = (const char *)memchr(line, '\n', end - line);
+    if (!lineEnd) lineEnd = end;
+
+    parse_Line(line, lineEnd, chunk);
+
+    line = lineEnd + 1;
+  }
+}
+
+// Parses an OBJ file and its MTL files. The file is split into line aligned
+// chunks, parsed in parallel, and merged in file order, so the result doesn't
+// depend on the number of threads. Polygons are triangulated as fans.
+bool Load_OBJ(const std::string &fileName, const std::string &assetsFolder,
+              Obj_Data &obj) {
+  Mapped_File file;
+  if (!file.open(fileName)) return false;
+
+  const char *data = (const char *)file.data;
+  const size_t size = file.size;
+
+  // split file into chunks of at least 1MB, ending at line breaks
+  size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t chunkSize = std::max(size / (4 * n_threads), size_t(1) << 20);
+
+  std::vector<size_t> bounds(1, 0);
+  while (bounds.back() < size) {
+    size_t bound = std::min(bounds.back() + chunkSize, size);
+    const char *lineEnd =
+        (const char *)memchr(data + bound, '\n', size - bound);
+    bounds.push_back(lineEnd ? (lineEnd - data) + 1 : size);
+  }
+
+  size_t n_chunks = bounds.size() - 1;
+  std::vector<Obj_Chunk> chunks(n_chunks);
+  parallelFor(n_chunks, [&](size_t c) {
+    parse_Chunk(data + bounds[c], data + bounds[c + 1], chunks[c]);
+  });
+
+  // MTL files are read once, in file order
+  std::map<std::string, int> material_map;  // [Name, index] map
+  tinyobj::MaterialFileReader reader(assetsFolder);
+  for (size_t c = 0; c < n_chunks; c++) {
+    for (size_t i = 0; i < chunks[c].mtllibs.size(); i++) {
+      std::string warn, err;
+      reader(chunks[c].mtllibs[i], &obj.materials, &material_map, &warn,
+             &err);
+
+      if (!warn.empty()) std::cout << "WARN: " << warn << std::endl;
+      if (!err.empty()) std::cerr << "ERR: " << err << std::endl;
+    }
+  }
+
+  // offsets of each chunk in the merged arrays, and the material id each
+  // chunk starts with
+  std::vector<size_t> v_offset(n_chunks + 1, 0), t_offset(n_chunks + 1, 0),
+      n_offset(n_chunks + 1, 0), f_offset(n_chunks + 1, 0);
+  std::vector<std::vector<int>> usemtl_ids(n_chunks);
+  std::vector<int> first_material(n_chunks, -1);
+  for (size_t c = 0; c < n_chunks; c++) {
+    const Obj_Chunk &chunk = chunks[c];
+    v_offset[c + 1] = v_offset[c] + chunk.vertices.size();
+    t_offset[c + 1] = t_offset[c] + chunk.texcoords.size();
+    n_offset[c + 1] = n_offset[c] + chunk.normals.size();
+    f_offset[c + 1] = f_offset[c] + chunk.face_usemtl.size();
+
+    // material names are looked up once per usemtl, not once per face
+    for (size_t i = 0; i < chunk.usemtl.size(); i++) {
+      auto it = material_map.find(chunk.usemtl[i]);
+      usemtl_ids[c].push_back(it != material_map.end() ? it->second : -1);
+    }
+
+    if (c + 1 < n_chunks)
+      first_material[c + 1] =
+          usemtl_ids[c].empty() ? first_material[c] : usemtl_ids[c].back();
+  }
+
+  obj.vertices.resize(v_offset[n_chunks]);
+  obj.texcoords.resize(t_offset[n_chunks]);
+  obj.normals.resize(n_offset[n_chunks]);
+  obj.corners.resize(3 * f_offset[n_chunks]);
+  obj.face_materials.resize(f_offset[n_chunks]);
+
+  // merge chunks, resolving indices against the merged arrays
+  parallelFor(n_chunks, [&](size_t c) {
+    const Obj_Chunk &chunk = chunks[c];
+    std::copy(chunk.vertices.begin(), chunk.vertices.end(),
+              obj.vertices.begin() + v_offset[c]);
+    std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+              obj.texcoords.begin() + t_offset[c]);
+    std::copy(chunk.normals.begin(), chunk.normals.end(),
+              obj.normals.begin() + n_offset[c]);
+
+    for (size_t i = 0; i < chunk.corners.size(); i++) {
+      Obj_Corner corner = chunk.corners[i];
+      unsigned char relative = chunk.relative[i];
+
+      // absolute indices are 1-based, 0 means the attribute is missing
+      corner.v = (relative & 1) ? corner.v + (int)v_offset[c] : corner.v - 1;
+      corner.t = (relative & 2) ? corner.t + (int)t_offset[c] : corner.t - 1;
+      corner.n = (relative & 4) ? corner.n + (int)n_offset[c] : corner.n - 1;
+
+      obj.corners[3 * f_offset[c] + i] = corner;
+    }
+
+    for (size_t f = 0; f < chunk.face_usemtl.size(); f++) {
+      int usemtl = chunk.face_usemtl[f];
+      obj.face_materials[f_offset[c] + f] =
+          usemtl < 0 ? first_material[c] : usemtl_ids[c][usemtl];
+    }
+  });
+
+  // reject indices past the end of the file's attributes
+  for (size_t i = 0; i < obj.corners.size(); i++) {
+    const Obj_Corner &corner = obj.corners[i];
+    if (corner.v < 0 || corner.v >= (int)obj.vertices.size() ||
+        corner.t < -1 || corner.t >= (int)obj.texcoords.size() ||
+        corner.n < -1 || corner.n >= (int)obj.normals.size()) {
+      std::cerr << "ERR: invalid face index in " << fileName << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+#endif
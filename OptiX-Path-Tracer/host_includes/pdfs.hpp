@@ -1,19 +1,40 @@
 #ifndef PDFSH
 #define PDFSH
 
+#include "buffers.hpp"
 #include "host_common.hpp"
 #include "programs.hpp"
+#include "textures.hpp"
 
 /*! The precompiled programs code (in ptx) that our cmake script
 will precompile (to ptx) and link to the generated executable */
 extern "C" const char Rect_PDF_PTX[];
 extern "C" const char Sphere_PDF_PTX[];
+extern "C" const char Environment_PDF_PTX[];
+extern "C" const char Mesh_PDF_PTX[];
 
 struct PDF {
   virtual Program createSample(Context &g_context) const = 0;
   virtual Program createPDF(Context &g_context) const = 0;
+
+  // Surface area of the light shape
+  virtual float area() const = 0;
+
+  // Number of faces that emit light
+  virtual int sides() const { return 1; }
 };
 
+// Adds a diffuse area light to the sampler. Its power, used to pick it, is
+// the emitted flux.
+void addLight(Light_Sampler &lights, const PDF &pdf, const float3 &emission,
+              Context &g_context) {
+  lights.pdf.push_back(pdf.createPDF(g_context));
+  lights.sample.push_back(pdf.createSample(g_context));
+  lights.emissions.push_back(emission);
+  lights.powers.push_back(::luminance(emission) * PI_F * pdf.area() *
+                          pdf.sides());
+}
+
 struct Rectangle_PDF : public PDF {
   Rectangle_PDF(const float aa0, const float aa1, const float bb0,
                 const float bb1, const float kk, const AXIS aax)
@@ -75,6 +96,8 @@ struct Rectangle_PDF : public PDF {
     return pdf;
   }
 
+  virtual float area() const override { return (a1 - a0) * (b1 - b0); }
+
   float a0, a1, b0, b1, k;
   AXIS ax;
 };
@@ -104,8 +127,152 @@ struct Sphere_PDF : public PDF {
     return pdf;
   }
 
+  virtual float area() const override { return 4.f * PI_F * radius * radius; }
+
   float radius;
   float3 center;
 };
 
-#endif
\ No newline at end of file
+// Emissive triangle mesh, sampled uniformly over its area. Vertices are in
+// world space, three per triangle.
+struct Mesh_Light_PDF : public PDF {
+  Mesh_Light_PDF(const std::vector<float3> &v) : vertices(v), totalArea(0.f) {
+    for (size_t i = 0; i + 2 < vertices.size(); i += 3) {
+      float3 e1 = vertices[i + 1] - vertices[i];
+      float3 e2 = vertices[i + 2] - vertices[i];
+      areas.push_back(0.5f * length(cross(e1, e2)));
+      totalArea += areas.back();
+    }
+  }
+
+  virtual Program createSample(Context &g_context) const override {
+    Program sample = createProgram(Mesh_PDF_PTX, "Sample", g_context);
+
+    // triangles are picked proportionally to their area
+    Alias_Table triangles = buildAliasTable(areas);
+    sample["light_vertices"]->setBuffer(
+        createBuffer(vertices.data(), vertices.size(), g_context));
+    sample["triangle_threshold"]->setBuffer(
+        createBuffer(triangles.threshold, g_context));
+    sample["triangle_alias"]->setBuffer(
+        createBuffer(triangles.alias, g_context));
+    sample["total_area"]->setFloat(totalArea);
+
+    return sample;
+  }
+
+  virtual Program createPDF(Context &g_context) const override {
+    return createProgram(Mesh_PDF_PTX, "PDF", g_context);
+  }
+
+  virtual float area() const override { return totalArea; }
+
+  // triangles are sampled from both sides, so both faces emit
+  virtual int sides() const override { return 2; }
+
+  std::vector<float3> vertices;
+  std::vector<float> areas;
+  float totalArea;
+};
+
+// Sampling distribution of an environment map, the marginal CDF of its rows
+// and the conditional CDF of the texels in each row
+struct Environment_CDF {
+  Buffer marginal, conditional;
+};
+
+// Environment maps are sampled from a mip level at most this wide
+const size_t ENVIRONMENT_CDF_WIDTH = 1024;
+
+struct Environment_PDF : public PDF {
+  Environment_PDF(const HDR_Texture &t, const bool spherical)
+      : texture(t), isSpherical(spherical) {}
+
+  virtual Program createSample(Context &g_context) const override {
+    Program sample = createProgram(Environment_PDF_PTX, "Sample", g_context);
+    setParameters(sample, g_context);
+
+    return sample;
+  }
+
+  virtual Program createPDF(Context &g_context) const override {
+    Program pdf = createProgram(Environment_PDF_PTX, "PDF", g_context);
+    setParameters(pdf, g_context);
+
+    return pdf;
+  }
+
+  // Creates the program returning the map radiance in a direction
+  Program createRadiance(Context &g_context) const {
+    Program radiance =
+        createProgram(Environment_PDF_PTX, "Radiance", g_context);
+    setParameters(radiance, g_context);
+
+    return radiance;
+  }
+
+  // Infinitely far away, Light_Sampler weights it separately
+  virtual float area() const override { return 0.f; }
+
+  void setParameters(Program &prog, Context &g_context) const {
+    static std::map<std::pair<RTcontext, std::string>, Environment_CDF> cache;
+    Environment_CDF cdf = getShared(cache, texture.samplerKey(), g_context,
+                                    [&]() { return createCDF(g_context); });
+
+    prog["sample_texture"]->setProgramId(texture.assignTo(g_context));
+    prog["isSpherical"]->setInt(isSpherical);
+    prog["marginal_cdf"]->setBuffer(cdf.marginal);
+    prog["conditional_cdf"]->setBuffer(cdf.conditional);
+  }
+
+  // Builds the CDFs from texel luminance, weighted by the solid angle each
+  // row of texels covers
+  Environment_CDF createCDF(Context &g_context) const {
+    size_t nx, ny;
+    std::vector<float> texels =
+        texture.luminance(g_context, ENVIRONMENT_CDF_WIDTH, nx, ny);
+
+    // accumulate and normalize each row, a row per task
+    std::vector<double> rowSums(ny);
+    parallelFor(ny, [&](size_t j) {
+      float sinTheta = sinf(PI_F * (j + 0.5f) / ny);
+      float *row = &texels[j * nx];
+
+      double sum = 0.0;
+      for (size_t i = 0; i < nx; i++) {
+        sum += row[i] * sinTheta;
+        row[i] = float(sum);
+      }
+
+      // black rows are never picked, any valid CDF will do
+      for (size_t i = 0; i < nx; i++)
+        row[i] = sum > 0.0 ? float(row[i] / sum) : float(i + 1) / nx;
+      rowSums[j] = sum;
+    });
+
+    std::vector<float> rows(ny);
+    double total = 0.0;
+    for (size_t j = 0; j < ny; j++) {
+      total += rowSums[j];
+      rows[j] = float(total);
+    }
+
+    for (size_t j = 0; j < ny; j++)
+      rows[j] = total > 0.0 ? float(rows[j] / total) : float(j + 1) / ny;
+
+    Environment_CDF cdf;
+    cdf.marginal = createBuffer(rows, g_context);
+
+    cdf.conditional =
+        g_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT, nx, ny);
+    memcpy(cdf.conditional->map(), texels.data(), nx * ny * sizeof(float));
+    cdf.conditional->unmap();
+
+    return cdf;
+  }
+
+  const HDR_Texture texture;
+  const bool isSpherical;
+};
+
+#endif
@@ -14,10 +14,22 @@ extern "C" const char Miss_PTX[];
 extern "C" const char Exception_PTX[];
 extern "C" const char Raygen_PTX[];
 
+// Entry points of the context
+typedef enum {
+  RENDER,
+  TONEMAP,
+  GENERATE_PATHS,
+  EXTEND_PATHS,
+  ACCUMULATE_PATHS
+} Entry_Points;
+
 void setRayGenerationProgram(Context &g_context, Light_Sampler &lights) {
   // create raygen program of the scene
   Program raygen = createProgram(Raygen_PTX, "renderPixel", g_context);
 
+  // converts the acc buffer to the display buffer
+  Program tonemap = createProgram(Raygen_PTX, "tonemap", g_context);
+
   // Light sampling params and buffers
   g_context["Light_Sample"]->setBuffer(createBuffer(lights.sample, g_context));
   g_context["Light_PDF"]->setBuffer(createBuffer(lights.pdf, g_context));
@@ -25,15 +37,39 @@ void setRayGenerationProgram(Context &g_context, Light_Sampler &lights) {
       createBuffer(lights.emissions, g_context));
   g_context["numLights"]->setInt((int)lights.emissions.size());
 
-  g_context->setEntryPointCount(1);
-  g_context->setRayGenerationProgram(/*program ID:*/ 0, raygen);
+  // mesh lights can't be found by BSDF samples
+  std::vector<int> isMesh(lights.emissions.size(), 0);
+  for (size_t i = 0; i < lights.meshLights.size(); i++)
+    isMesh[lights.meshLights[i]] = 1;
+  g_context["Light_Is_Mesh"]->setBuffer(createBuffer(isMesh, g_context));
+
+  // lights are picked proportionally to their power
+  Alias_Table selection = buildAliasTable(lights.weights());
+  g_context["Light_Threshold"]->setBuffer(
+      createBuffer(selection.threshold, g_context));
+  g_context["Light_Alias"]->setBuffer(createBuffer(selection.alias, g_context));
+  g_context["Light_Selection_PDF"]->setBuffer(
+      createBuffer(selection.pdf, g_context));
+
+  std::vector<Program> environment;
+  if (lights.environment >= 0)
+    environment.push_back(lights.environmentRadiance);
+  g_context["Environment_Light"]->setInt(lights.environment);
+  g_context["Environment_Radiance"]->setBuffer(
+      createBuffer(environment, g_context));
+
+  g_context->setEntryPointCount(2);
+  g_context->setRayGenerationProgram(/*program ID:*/ RENDER, raygen);
+  g_context->setRayGenerationProgram(/*program ID:*/ TONEMAP, tonemap);
 }
 
 typedef enum { GRADIENT, CONSTANT, IMG, HDR } Miss_Programs;
 
-// Image Miss Programs
+// Image Miss Programs. If a light sampler is given, HDR maps are also added
+// to it as an importance sampled light, which must happen before the lights
+// are passed to setRayGenerationProgram.
 void setMissProgram(Context &g_context, Miss_Programs id, std::string fileName,
-                    bool isSpherical = true) {
+                    bool isSpherical = true, Light_Sampler *lights = nullptr) {
   Program missProgram;
 
   // LDR image background
@@ -53,6 +89,17 @@ void setMissProgram(Context &g_context, Miss_Programs id, std::string fileName,
 
     // set to false if it's a cylindrical map
     missProgram["isSpherical"]->setInt(isSpherical);
+
+    // importance sample the map as a light
+    if (lights) {
+      Environment_PDF environment(img, isSpherical);
+      lights->environment = (int)lights->emissions.size();
+      lights->environmentRadiance = environment.createRadiance(g_context);
+      lights->sample.push_back(environment.createSample(g_context));
+      lights->pdf.push_back(environment.createPDF(g_context));
+      lights->emissions.push_back(make_float3(1.f));
+      lights->powers.push_back(0.f);  // set by Light_Sampler::weights
+    }
   }
 
   else
@@ -91,9 +138,23 @@ void setMissProgram(Context &g_context, Miss_Programs id,
   g_context->setMissProgram(/*program ID:*/ 0, missProgram);
 }
 
+// Adds the entry points of the wavefront integrator. Only renders that use it
+// pay for compiling them.
+void setWavefrontPrograms(Context &g_context) {
+  g_context->setEntryPointCount(5);
+  g_context->setRayGenerationProgram(
+      GENERATE_PATHS, createProgram(Raygen_PTX, "generatePaths", g_context));
+  g_context->setRayGenerationProgram(
+      EXTEND_PATHS, createProgram(Raygen_PTX, "extendPaths", g_context));
+  g_context->setRayGenerationProgram(
+      ACCUMULATE_PATHS,
+      createProgram(Raygen_PTX, "accumulatePaths", g_context));
+}
+
 void setExceptionProgram(Context &g_context) {
   Program prog = createProgram(Exception_PTX, "exception_program", g_context);
-  g_context->setExceptionProgram(/*program ID:*/ 0, prog);
+  for (unsigned int i = 0; i < g_context->getEntryPointCount(); i++)
+    g_context->setExceptionProgram(/*program ID:*/ i, prog);
 }
 
 #endif
\ No newline at end of file
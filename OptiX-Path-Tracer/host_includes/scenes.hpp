@@ -31,12 +31,13 @@ void InOneWeekend(App_State& app) {
   Group group = app.context->createGroup();
   group->setAcceleration(app.context->createAcceleration("Trbvh"));
 
-  // create geometries
+  // create geometries, all spheres share a single acceleration structure
   Hitable_List list;
+  Sphere_Batch* spheres = new Sphere_Batch();
   Texture* groundTx = new Constant_Texture(0.5f);
   BRDF* ground = new Lambertian(groundTx);
 
-  list.push(new Sphere(make_float3(0.f, -1000.f, -1.f), 1000.f, ground));
+  spheres->push(make_float3(0.f, -1000.f, -1.f), 1000.f, ground);
 
   for (int a = -11; a < 11; a++) {
     for (int b = -11; b < 11; b++) {
@@ -45,32 +46,33 @@ void InOneWeekend(App_State& app) {
       if (choose_mat < 0.8f) {
         Texture* tx = new Constant_Texture(rnd(), rnd(), rnd());
         BRDF* mt = new Lambertian(tx);
-        list.push(new Sphere(center, 0.2f, mt));
+        spheres->push(center, 0.2f, mt);
       } else if (choose_mat < 0.95f) {
         Texture* tx = new Constant_Texture(
             0.5f * (1.f + rnd()), 0.5f * (1.f + rnd()), 0.5f * (1.f + rnd()));
         BRDF* mt = new Metal(tx, 0.5f * rnd());
-        list.push(new Sphere(center, 0.2f, mt));
+        spheres->push(center, 0.2f, mt);
       } else {
         Texture* tx1 = new Constant_Texture(1.f);
         Texture* tx2 = new Constant_Texture(rnd(), rnd(), rnd());
         BRDF* mt = new Dielectric(tx1, tx2, 1.5, 0.f);
-        list.push(new Sphere(center, 0.2f, mt));
+        spheres->push(center, 0.2f, mt);
       }
     }
   }
 
   Texture* tx1 = new Constant_Texture(1.f);
   BRDF* mt0 = new Dielectric(tx1, tx1, 1.5, 0.f);
-  list.push(new Sphere(make_float3(4.f, 1.f, 0.f), 1.f, mt0));
+  spheres->push(make_float3(4.f, 1.f, 0.f), 1.f, mt0);
 
   Texture* tx2 = new Constant_Texture(0.4f, 0.2f, 0.1f);
   BRDF* mt2 = new Lambertian(tx2);
-  list.push(new Sphere(make_float3(0.f, 1.f, 0.5f), 1.f, mt2));
+  spheres->push(make_float3(0.f, 1.f, 0.5f), 1.f, mt2);
 
   Texture* tx3 = new Constant_Texture(0.7f, 0.6f, 0.5f);
   BRDF* mt3 = new Metal(tx3, 0.f);
-  list.push(new Sphere(make_float3(-4.f, 1.f, 1.f), 1.f, mt3));
+  spheres->push(make_float3(-4.f, 1.f, 1.f), 1.f, mt3);
+  list.push(spheres);
 
   // transforms list elements, one by one, and adds them to the graph
   list.addElementsTo(group, app.context);
@@ -98,9 +100,7 @@ void MovingSpheres(App_State& app) {
   // add light parameters and programs
   Light_Sampler lights;
   Rectangle_PDF rect_pdf(3.f, 5.f, 1.f, 3.f, -0.5f, Z_AXIS);
-  lights.pdf.push_back(rect_pdf.createPDF(app.context));
-  lights.sample.push_back(rect_pdf.createSample(app.context));
-  lights.emissions.push_back(make_float3(4.f));
+  addLight(lights, rect_pdf, make_float3(4.f), app.context);
 
   // Set the exception, ray generation and miss shader programs
   setRayGenerationProgram(app.context, lights);
@@ -111,13 +111,14 @@ void MovingSpheres(App_State& app) {
   Group group = app.context->createGroup();
   group->setAcceleration(app.context->createAcceleration("Trbvh"));
 
-  // create scene
+  // create scene, all spheres share a single acceleration structure
   Hitable_List list;
+  Sphere_Batch* spheres = new Sphere_Batch();
   Texture* ck1 = new Constant_Texture(0.2f, 0.3f, 0.1f);
   Texture* ck2 = new Constant_Texture(0.9f, 0.9f, 0.9f);
   Texture* groundTx = new Checker_Texture(ck1, ck2);
   BRDF* ground = new Lambertian(groundTx);
-  list.push(new Sphere(make_float3(0.f, -1000.f, -1.f), 1000.f, ground));
+  spheres->push(make_float3(0.f, -1000.f, -1.f), 1000.f, ground);
 
   // Small spheres
   for (int a = -11; a < 11; a++) {
@@ -129,17 +130,17 @@ void MovingSpheres(App_State& app) {
         Texture* mtx = new Constant_Texture(
             0.5f * (1.f + rnd()), 0.5f * (1.f + rnd()), 0.5f * (1.f + rnd()));
         BRDF* lmt = new Lambertian(mtx);
-        list.push(new Sphere(center, 0.2f, lmt));
+        spheres->push(center, 0.2f, lmt);
       } else if (choose_mat < (2.f / 3)) {
         Texture* mtx = new Constant_Texture(
             0.5f * (1.f + rnd()), 0.5f * (1.f + rnd()), 0.5f * (1.f + rnd()));
         BRDF* lmt = new Metal(mtx, 0.5f * rnd());
-        list.push(new Sphere(center, 0.2f, lmt));
+        spheres->push(center, 0.2f, lmt);
       } else {
         Texture* mtx = new Constant_Texture(
             0.5f * (1.f + rnd()), 0.5f * (1.f + rnd()), 0.5f * (1.f + rnd()));
         BRDF* lmt = new Dielectric(mtx, mtx, 1.5, 0.f);
-        list.push(new Sphere(center, 0.2f, lmt));
+        spheres->push(center, 0.2f, lmt);
       }
     }
   }
@@ -147,18 +148,19 @@ void MovingSpheres(App_State& app) {
   // Earth
   Texture* etx = new Image_Texture("../../../assets/other_textures/map.jpg");
   BRDF* emt = new Lambertian(etx);
-  list.push(new Sphere(make_float3(-4.f, 1.f, 2.f), 1.f, emt));
+  spheres->push(make_float3(-4.f, 1.f, 2.f), 1.f, emt);
 
   // Glass Sphere
   Texture* gtx1 = new Constant_Texture(1.f);
   Texture* gtx2 = new Constant_Texture(rnd(), rnd(), rnd());
   BRDF* gmt = new Dielectric(gtx1, gtx2, 1.5, 0.f);
-  list.push(new Sphere(make_float3(4.f, 1.f, 1.f), 1.f, gmt));
+  spheres->push(make_float3(4.f, 1.f, 1.f), 1.f, gmt);
 
   // 'rusty' Metal Sphere
   Texture* mtx = new Noise_Texture(4.f);
   BRDF* mmt = new Metal(mtx, 0.f);
-  list.push(new Sphere(make_float3(0.f, 1.f, 1.5f), 1.f, mmt));
+  spheres->push(make_float3(0.f, 1.f, 1.5f), 1.f, mmt);
+  list.push(spheres);
 
   // Light
   Texture* ltx = new Constant_Texture(4.f);
@@ -191,14 +193,10 @@ void Cornell(App_State& app) {
   // add light parameters and programs
   Light_Sampler lights;
   Rectangle_PDF rect_pdf(213.f, 343.f, 227.f, 332.f, 554.f, Y_AXIS);
-  lights.pdf.push_back(rect_pdf.createPDF(app.context));
-  lights.sample.push_back(rect_pdf.createSample(app.context));
-  lights.emissions.push_back(make_float3(7.f));
+  addLight(lights, rect_pdf, make_float3(7.f), app.context);
 
   /*Sphere_PDF sph_pdf(make_float3(555.f - 100.f, 100.f, 100.f), 40.f);
-  lights.pdf.push_back(sph_pdf.createPDF(app.context));
-  lights.sample.push_back(sph_pdf.createSample(app.context));
-  lights.emissions.push_back(make_float3(7.f));*/
+  addLight(lights, sph_pdf, make_float3(7.f), app.context);*/
 
   // Set the exception, ray generation and miss shader programs
   setRayGenerationProgram(app.context, lights);
@@ -294,9 +292,7 @@ void Final_Next_Week(App_State& app) {
 
   Light_Sampler lights;
   Rectangle_PDF rect_pdf(113.f, 443.f, 127.f, 432.f, 554.f, Y_AXIS);
-  lights.pdf.push_back(rect_pdf.createPDF(app.context));
-  lights.sample.push_back(rect_pdf.createSample(app.context));
-  lights.emissions.push_back(make_float3(7.f));
+  addLight(lights, rect_pdf, make_float3(7.f), app.context);
 
   // Set the exception, ray generation and miss shader programs
   setRayGenerationProgram(app.context, lights);
@@ -306,7 +302,9 @@ void Final_Next_Week(App_State& app) {
   Group group = app.context->createGroup();
   group->setAcceleration(app.context->createAcceleration("Trbvh"));
 
+  // spheres share a single acceleration structure
   Hitable_List list;
+  Sphere_Batch* spheres = new Sphere_Batch();
 
   Texture* groundTx = new Constant_Texture(0.48f, 0.83f, 0.53f);
   BRDF* ground = new Lambertian(groundTx);
@@ -336,21 +334,21 @@ void Final_Next_Week(App_State& app) {
   float3 center = make_float3(400.f, 400.f, 200.f);
   Texture* brownTx = new Constant_Texture(0.7f, 0.3f, 0.1f);
   BRDF* brown = new Lambertian(brownTx);
-  list.push(new Sphere(center, 50.f, brown));
+  spheres->push(center, 50.f, brown);
 
   // glass sphere
   Texture* glassTx1 = new Constant_Texture(1.f);
   BRDF* glass = new Dielectric(glassTx1, glassTx1, 1.5f);
-  list.push(new Sphere(make_float3(260.f, 150.f, 45.f), 50.f, glass));
+  spheres->push(make_float3(260.f, 150.f, 45.f), 50.f, glass);
 
   // metal sphere
   Texture* metalTx = new Constant_Texture(0.8f, 0.8f, 0.9f);
   BRDF* metal = new Metal(metalTx, 10.f);
-  list.push(new Sphere(make_float3(0.f, 150.f, 145.f), 50.f, metal));
+  spheres->push(make_float3(0.f, 150.f, 145.f), 50.f, metal);
 
   // blue sphere
   // glass sphere
-  list.push(new Sphere(make_float3(360.f, 150.f, 45.f), 70.f, glass));
+  spheres->push(make_float3(360.f, 150.f, 45.f), 70.f, glass);
   // blue fog
   Texture* blueTx = new Constant_Texture(0.2f, 0.4f, 0.9f);
   BRDF* blueFog = new Isotropic(blueTx);
@@ -364,24 +362,25 @@ void Final_Next_Week(App_State& app) {
   // earth
   Texture* etx = new Image_Texture("../../../assets/other_textures/map.jpg");
   BRDF* emt = new Lambertian(etx);
-  list.push(new Sphere(make_float3(400.f, 200.f, 400.f), 100.f, emt));
+  spheres->push(make_float3(400.f, 200.f, 400.f), 100.f, emt);
 
   // Perlin sphere
   Texture* perlinTx = new Noise_Texture(0.1f);
   BRDF* noise = new Lambertian(perlinTx);
-  list.push(new Sphere(make_float3(220.f, 280.f, 300.f), 80.f, noise));
+  spheres->push(make_float3(220.f, 280.f, 300.f), 80.f, noise);
+  list.push(spheres);
 
   // group of small spheres
-  Hitable_List spheres;
+  Sphere_Batch* cluster = new Sphere_Batch();
   Texture* whiteTx = new Constant_Texture(0.73f);
   BRDF* whiteMt = new Lambertian(whiteTx);
   for (int j = 0; j < 1000; j++) {
     center = make_float3(165 * rnd(), 165 * rnd(), 165 * rnd());
-    spheres.push(new Sphere(center, 10.f, whiteMt));
+    cluster->push(center, 10.f, whiteMt);
   }
-  spheres.translate(make_float3(-100.f, 270.f, 395.f));
-  spheres.rotate(15.f, Y_AXIS);
-  spheres.addListTo(group, app.context);
+  cluster->translate(make_float3(-100.f, 270.f, 395.f));
+  cluster->rotate(15.f, Y_AXIS);
+  list.push(cluster);
 
   // transforms list elements, one by one, and adds them to the graph
   list.addElementsTo(group, app.context);
@@ -410,11 +409,12 @@ void Test_Scene(App_State& app) {
   Light_Sampler lights;
 
   // Set the exception, ray generation and miss shader programs
-  setRayGenerationProgram(app.context, lights);
-  // setMissProgram(app.context, HDR, "../../../assets/hdr/ennis.hdr");
+  // setMissProgram(app.context, HDR, "../../../assets/hdr/ennis.hdr", true,
+  //                &lights);  // sampled as a light
   setMissProgram(app.context, GRADIENT,          // gradient sky pattern
                  make_float3(1.f),               // white
                  make_float3(0.5f, 0.7f, 1.f));  // light blue
+  setRayGenerationProgram(app.context, lights);
   setExceptionProgram(app.context);
 
   // create scene group
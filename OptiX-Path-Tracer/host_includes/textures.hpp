@@ -14,7 +14,19 @@ extern "C" const char Gradient_PTX[];
 extern "C" const char Vector_Tex_PTX[];
 
 struct Texture {
-  virtual Program assignTo(Context &g_context) const = 0;
+  // Returns the texture's callable program. Textures with the same parameters
+  // share a single program.
+  Program assignTo(Context &g_context) const {
+    static std::map<std::pair<RTcontext, std::string>, Program> cache;
+    return getShared(cache, key(), g_context,
+                     [&]() { return create(g_context); });
+  }
+
+  // Creates a new callable program for the texture
+  virtual Program create(Context &g_context) const = 0;
+
+  // Identifies the texture by its parameters, empty if it can't be shared
+  virtual std::string key() const { return ""; }
 };
 
 struct Constant_Texture : public Texture {
@@ -25,7 +37,7 @@ struct Constant_Texture : public Texture {
   Constant_Texture(const float &r, const float &g, const float &b)
       : color(make_float3(r, g, b)) {}
 
-  virtual Program assignTo(Context &g_context) const override {
+  virtual Program create(Context &g_context) const override {
     Program prog = createProgram(Color_PTX, "sample_texture", g_context);
 
     prog["color"]->set3fv(&color.x);
@@ -33,13 +45,17 @@ struct Constant_Texture : public Texture {
     return prog;
   }
 
+  virtual std::string key() const override {
+    return Param_Key("constant") << color;
+  }
+
   const float3 color;
 };
 
 struct Checker_Texture : public Texture {
   Checker_Texture(const Texture *o, const Texture *e) : odd(o), even(e) {}
 
-  virtual Program assignTo(Context &g_context) const override {
+  virtual Program create(Context &g_context) const override {
     Program textProg = createProgram(Checker_PTX, "sample_texture", g_context);
 
     textProg["odd"]->setProgramId(odd->assignTo(g_context));
@@ -48,6 +64,10 @@ struct Checker_Texture : public Texture {
     return textProg;
   }
 
+  virtual std::string key() const override {
+    return Param_Key("checker") << odd->key() << even->key();
+  }
+
   const Texture *odd;
   const Texture *even;
 };
@@ -80,7 +100,7 @@ struct Noise_Texture : public Texture {
     perm_buffer->unmap();
   }
 
-  virtual Program assignTo(Context &g_context) const override {
+  virtual Program create(Context &g_context) const override {
     Buffer ranvec =
         g_context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT3, 256);
     float3 *ranvec_map = static_cast<float3 *>(ranvec->map());
@@ -107,126 +127,395 @@ struct Noise_Texture : public Texture {
     return textProg;
   }
 
+  // Noise textures are never shared, each one gets its own random tables
+
   const float scale;
   const AXIS ax;
 };
 
+// Returns the sampler cached under the given key for this context, creating
+// it if needed. Images are decoded and uploaded once per path and sampler
+// settings, however many textures use them.
+template <typename Create_Function>
+TextureSampler getSampler(const std::string &key, Context &g_context,
+                          Create_Function create) {
+  static std::map<std::pair<RTcontext, std::string>, TextureSampler> cache;
+  return getShared(cache, key, g_context, create);
+}
+
+// Number of levels in the full mip chain of a nx * ny image
+inline unsigned int mipLevelCount(size_t nx, size_t ny) {
+  unsigned int levels = 1;
+  while (nx > 1 || ny > 1) {
+    nx = std::max<size_t>(nx / 2, 1);
+    ny = std::max<size_t>(ny / 2, 1);
+    levels++;
+  }
+
+  return levels;
+}
+
+inline unsigned char average(unsigned char a, unsigned char b,
+                             unsigned char c, unsigned char d) {
+  return (unsigned char)((a + b + c + d + 2) / 4);
+}
+
+inline uchar4 average(uchar4 a, uchar4 b, uchar4 c, uchar4 d) {
+  return make_uchar4((a.x + b.x + c.x + d.x + 2) / 4,
+                     (a.y + b.y + c.y + d.y + 2) / 4,
+                     (a.z + b.z + c.z + d.z + 2) / 4,
+                     (a.w + b.w + c.w + d.w + 2) / 4);
+}
+
+inline float4 average(float4 a, float4 b, float4 c, float4 d) {
+  return make_float4((a.x + b.x + c.x + d.x) / 4.f,
+                     (a.y + b.y + c.y + d.y) / 4.f,
+                     (a.z + b.z + c.z + d.z) / 4.f,
+                     (a.w + b.w + c.w + d.w) / 4.f);
+}
+
+// Box filters an image down to the next mip level, a row per task. Odd
+// edges are clamped, so the last row or column is counted twice.
+template <typename T>
+std::vector<T> downsample(const std::vector<T> &src, size_t nx, size_t ny,
+                          size_t mx, size_t my) {
+  std::vector<T> dst(mx * my);
+
+  parallelFor(my, [&](size_t j) {
+    const T *row0 = &src[std::min(2 * j, ny - 1) * nx];
+    const T *row1 = &src[std::min(2 * j + 1, ny - 1) * nx];
+
+    for (size_t i = 0; i < mx; i++) {
+      size_t i0 = std::min(2 * i, nx - 1), i1 = std::min(2 * i + 1, nx - 1);
+      dst[j * mx + i] = average(row0[i0], row0[i1], row1[i0], row1[i1]);
+    }
+  });
+
+  return dst;
+}
+
+// RT_FORMAT_HALF4 texel
+struct Half4 {
+  uint16_t x, y, z, w;
+};
+
+// Largest finite half float
+const float HALF_MAX = 65504.f;
+
+// Converts a float to a half float, rounding to nearest even
+inline uint16_t floatToHalf(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t mantissa = bits & 0x7fffff;
+  int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+
+  // infinity and NaN
+  if (((bits >> 23) & 0xff) == 0xff)
+    return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+  // too large, clamp to the largest half so filtering never sees infinity
+  if (exponent >= 31) return uint16_t(sign | 0x7bff);
+
+  // too small for a normal half, shift in the implicit bit
+  int shift = 13;
+  if (exponent <= 0) {
+    if (exponent < -10) return uint16_t(sign);
+    mantissa |= 0x800000;
+    shift = 14 - exponent;
+    exponent = 0;
+  }
+
+  // a carry out of the mantissa correctly bumps the exponent
+  uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> shift);
+  uint32_t rest = mantissa & ((1u << shift) - 1), middle = 1u << (shift - 1);
+  if (rest > middle || (rest == middle && (half & 1))) half++;
+
+  return uint16_t(sign | std::min<uint32_t>(half, 0x7bff));
+}
+
+// Converts a half float back to a float
+inline float halfToFloat(uint16_t h) {
+  uint32_t sign = uint32_t(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+
+  // subnormal halves are normal floats
+  if (exponent == 0) {
+    float value = ldexpf(float(mantissa), -24);
+    return sign ? -value : value;
+  }
+
+  uint32_t bits;
+  if (exponent == 31)  // infinity and NaN
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  else
+    bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Converts generated texels to the buffer format
+template <typename T>
+inline void convert(const T &in, T &out) {
+  out = in;
+}
+
+inline void convert(const float4 &in, Half4 &out) {
+  out = {floatToHalf(in.x), floatToHalf(in.y), floatToHalf(in.z),
+         floatToHalf(in.w)};
+}
+
+// Creates a mip mapped buffer from a level 0 image, generating every other
+// level on the host. Levels are filtered as T and stored as Stored texels.
+template <typename Stored, typename T>
+Buffer createMipBuffer(std::vector<T> level, size_t nx, size_t ny,
+                       RTformat format, Context &context) {
+  Buffer buffer = context->createBuffer(RT_BUFFER_INPUT, format, nx, ny);
+  unsigned int levels = mipLevelCount(nx, ny);
+  buffer->setMipLevelCount(levels);
+
+  for (unsigned int l = 0; l < levels; l++) {
+    if (l > 0) {
+      size_t mx = std::max<size_t>(nx / 2, 1);
+      size_t my = std::max<size_t>(ny / 2, 1);
+      level = downsample(level, nx, ny, mx, my);
+      nx = mx;
+      ny = my;
+    }
+
+    Stored *data = static_cast<Stored *>(buffer->map(l));
+    parallelFor(ny, [&](size_t j) {
+      for (size_t i = j * nx; i < (j + 1) * nx; i++) convert(level[i], data[i]);
+    });
+    buffer->unmap(l);
+  }
+
+  return buffer;
+}
+
+// Mean of a sampler's level 0 width and height, used to pick mip levels
+inline float textureSize(TextureSampler sampler) {
+  size_t nx, ny;
+  sampler->getBuffer(0u, 0u)->getSize(nx, ny);
+  return sqrtf(float(nx) * float(ny));
+}
+
+// Sets the variables image_texture.cu needs to sample a texture
+inline void setImageVariables(Program textProg, TextureSampler sampler) {
+  RTformat format = sampler->getBuffer(0u, 0u)->getFormat();
+
+  textProg["data"]->setTextureSampler(sampler);
+  textProg["texture_size"]->setFloat(textureSize(sampler));
+  textProg["single_channel"]->setInt(format == RT_FORMAT_UNSIGNED_BYTE);
+}
+
 struct Image_Texture : public Texture {
-  Image_Texture(const std::string f) : fileName(f) {}
+  Image_Texture(const std::string f, RTwrapmode wrap = RT_WRAP_REPEAT,
+                RTfiltermode filter = RT_FILTER_LINEAR)
+      : fileName(f), wrap(wrap), filter(filter) {}
 
   TextureSampler loadTexture(Context context,
                              const std::string fileName) const {
+    // grayscale images keep a single channel, others are expanded to RGBA
+    // since there are no three channel texture formats
+    int nx, ny, nn;
+    if (!stbi_info(fileName.c_str(), &nx, &ny, &nn)) {
+      printf("Image is invalid or hasn't been found.\n");
+      exitOnError();
+    }
+
+    if (nn == 1)
+      return loadTexels<unsigned char>(context, fileName,
+                                       RT_FORMAT_UNSIGNED_BYTE, 1);
+    else
+      return loadTexels<uchar4>(context, fileName, RT_FORMAT_UNSIGNED_BYTE4, 4);
+  }
+
+  // Loads the image with a given number of channels per texel T
+  template <typename T>
+  TextureSampler loadTexels(Context context, const std::string fileName,
+                            RTformat format, int channels) const {
     int nx, ny, nn;
     unsigned char *tex_data =
-        stbi_load((char *)fileName.c_str(), &nx, &ny, &nn, 0);
+        stbi_load(fileName.c_str(), &nx, &ny, &nn, channels);
 
     if (!tex_data) {
       printf("Image is invalid or hasn't been found.\n");
-      system("PAUSE");
-      exit(0);
+      exitOnError();
     }
 
     TextureSampler sampler = context->createTextureSampler();
-    sampler->setWrapMode(0, RT_WRAP_REPEAT);
-    sampler->setWrapMode(1, RT_WRAP_REPEAT);
-    sampler->setWrapMode(2, RT_WRAP_REPEAT);
+    sampler->setWrapMode(0, wrap);
+    sampler->setWrapMode(1, wrap);
+    sampler->setWrapMode(2, wrap);
     sampler->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
     sampler->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
     sampler->setMaxAnisotropy(1.f);
-    sampler->setMipLevelCount(1u);
     sampler->setArraySize(1u);
 
-    Buffer buffer = context->createBuffer(RT_BUFFER_INPUT,
-                                          RT_FORMAT_UNSIGNED_BYTE4, nx, ny);
-    unsigned char *buffer_data = static_cast<unsigned char *>(buffer->map());
-
-    for (int i = 0; i < nx; ++i)
-      for (int j = 0; j < ny; ++j) {
-        int bindex = (j * nx + i) * 4;
-        int iindex = ((ny - j - 1) * nx + i) * nn;
+    // images are stored top row first, flip them while copying rows
+    std::vector<T> image(size_t(nx) * ny);
+    size_t rowSize = size_t(nx) * sizeof(T);
+    parallelFor(ny, [&](size_t j) {
+      memcpy(&image[j * nx], tex_data + (ny - j - 1) * rowSize, rowSize);
+    });
+    stbi_image_free(tex_data);
 
-        buffer_data[bindex + 0] = tex_data[iindex + 0];
-        buffer_data[bindex + 1] = tex_data[iindex + 1];
-        buffer_data[bindex + 2] = tex_data[iindex + 2];
-
-        if (nn == 4)
-          buffer_data[bindex + 3] = tex_data[iindex + 3];
-        else  // 3-channel images
-          buffer_data[bindex + 3] = (unsigned char)1.f;
-      }
-
-    buffer->unmap();
+    Buffer buffer = createMipBuffer<T>(std::move(image), nx, ny, format,
+                                       context);
     sampler->setBuffer(0u, 0u, buffer);
-    sampler->setFilteringModes(RT_FILTER_LINEAR, RT_FILTER_LINEAR,
-                               RT_FILTER_NONE);
+    sampler->setFilteringModes(filter, filter, RT_FILTER_LINEAR);
 
     return sampler;
   }
 
-  virtual Program assignTo(Context &g_context) const override {
+  virtual Program create(Context &g_context) const override {
     Program textProg = createProgram(Image_PTX, "sample_texture", g_context);
 
-    textProg["data"]->setTextureSampler(loadTexture(g_context, fileName));
+    TextureSampler sampler = getSampler(samplerKey(), g_context, [&]() {
+      return loadTexture(g_context, fileName);
+    });
+    setImageVariables(textProg, sampler);
 
     return textProg;
   }
 
+  virtual std::string key() const override {
+    return Param_Key("image") << fileName << (int)wrap << (int)filter;
+  }
+
+  // Identifies the image and its sampler settings
+  std::string samplerKey() const {
+    return Param_Key("image sampler") << fileName << (int)wrap << (int)filter;
+  }
+
   const std::string fileName;
+  const RTwrapmode wrap;
+  const RTfiltermode filter;
 };
 
 struct HDR_Texture : public Texture {
-  HDR_Texture(const std::string f) : fileName(f) {}
+  HDR_Texture(const std::string f, RTwrapmode wrap = RT_WRAP_REPEAT,
+              RTfiltermode filter = RT_FILTER_LINEAR)
+      : fileName(f), wrap(wrap), filter(filter) {}
 
   TextureSampler loadHDRTexture(Context context,
                                 const std::string fileName) const {
     TextureSampler sampler = context->createTextureSampler();
-    sampler->setWrapMode(0, RT_WRAP_REPEAT);
-    sampler->setWrapMode(1, RT_WRAP_REPEAT);
+    sampler->setWrapMode(0, wrap);
+    sampler->setWrapMode(1, wrap);
     sampler->setIndexingMode(RT_TEXTURE_INDEX_NORMALIZED_COORDINATES);
     sampler->setReadMode(RT_TEXTURE_READ_NORMALIZED_FLOAT);
     sampler->setMaxAnisotropy(1.f);
-    sampler->setMipLevelCount(1u);
     sampler->setArraySize(1u);
 
     HDRImage HDRresult;
     if (!HDRLoader::load((char *)fileName.c_str(), HDRresult)) {
       printf("HDR Image is invalid or hasn't been found.\n");
-      system("PAUSE");
-      exit(0);
+      exitOnError();
     }
 
-    Buffer buffer = context->createBuffer(RT_BUFFER_INPUT, RT_FORMAT_FLOAT4,
-                                          HDRresult.width, HDRresult.height);
-    float *buffer_data = static_cast<float *>(buffer->map());
-
-    for (int i = 0; i < HDRresult.width; i++)
-      for (int j = 0; j < HDRresult.height; j++) {
-        int bindex = (j * HDRresult.width + i) * 4;
-        int iindex = (j * HDRresult.width + i) * 3;
-
-        buffer_data[bindex + 0] = HDRresult.colors[iindex + 0];
-        buffer_data[bindex + 1] = HDRresult.colors[iindex + 1];
-        buffer_data[bindex + 2] = HDRresult.colors[iindex + 2];
-        buffer_data[bindex + 3] = 0.f;
-      }
-
-    buffer->unmap();
+    // convert RGB to RGBA, a row per task
+    const int width = HDRresult.width;
+    const float *colors = HDRresult.colors;
+    std::vector<float4> image(size_t(width) * HDRresult.height);
+    parallelFor(HDRresult.height, [&](size_t j) {
+      float4 *dst = &image[j * width];
+      const float *src = colors + j * width * 3;
+
+      for (int i = 0; i < width; i++)
+        dst[i] = make_float4(src[3 * i + 0], src[3 * i + 1], src[3 * i + 2],
+                             0.f);
+    });
+
+    // half floats keep plenty of range for lighting at half the size, but
+    // unclipped suns can be brighter than the largest half
+    float brightest = 0.f;
+    for (const float4 &texel : image)
+      brightest = fmaxf(brightest, fmaxf(texel.x, fmaxf(texel.y, texel.z)));
+
+    Buffer buffer;
+    if (brightest > HALF_MAX)
+      buffer = createMipBuffer<float4>(std::move(image), width,
+                                       HDRresult.height, RT_FORMAT_FLOAT4,
+                                       context);
+    else
+      buffer = createMipBuffer<Half4>(std::move(image), width,
+                                      HDRresult.height, RT_FORMAT_HALF4,
+                                      context);
     sampler->setBuffer(0u, 0u, buffer);
-    sampler->setFilteringModes(RT_FILTER_LINEAR, RT_FILTER_LINEAR,
-                               RT_FILTER_NONE);
+    sampler->setFilteringModes(filter, filter, RT_FILTER_LINEAR);
 
     return sampler;
   }
 
-  virtual Program assignTo(Context &g_context) const override {
+  virtual Program create(Context &g_context) const override {
     Program textProg = createProgram(Image_PTX, "sample_texture", g_context);
-
-    textProg["data"]->setTextureSampler(loadHDRTexture(g_context, fileName));
+    setImageVariables(textProg, sharedSampler(g_context));
 
     return textProg;
   }
 
+  // Returns the sampler of the image, loading it on first use
+  TextureSampler sharedSampler(Context &g_context) const {
+    return getSampler(samplerKey(), g_context, [&]() {
+      return loadHDRTexture(g_context, fileName);
+    });
+  }
+
+  // Returns the luminance of the largest mip level at most maxWidth wide,
+  // read back from the uploaded texture
+  std::vector<float> luminance(Context &g_context, size_t maxWidth,
+                               size_t &nx, size_t &ny) const {
+    Buffer buffer = sharedSampler(g_context)->getBuffer(0u, 0u);
+
+    unsigned int level = 0;
+    buffer->getMipLevelSize(level, nx, ny);
+    while (nx > maxWidth && level + 1 < buffer->getMipLevelCount())
+      buffer->getMipLevelSize(++level, nx, ny);
+
+    std::vector<float> result(nx * ny);
+    const void *data = buffer->map(level, RT_BUFFER_MAP_READ);
+    bool isHalf = buffer->getFormat() == RT_FORMAT_HALF4;
+
+    parallelFor(ny, [&](size_t j) {
+      for (size_t i = j * nx; i < (j + 1) * nx; i++) {
+        float3 color;
+        if (isHalf) {
+          const Half4 &texel = static_cast<const Half4 *>(data)[i];
+          color = make_float3(halfToFloat(texel.x), halfToFloat(texel.y),
+                              halfToFloat(texel.z));
+        } else {
+          const float4 &texel = static_cast<const float4 *>(data)[i];
+          color = make_float3(texel.x, texel.y, texel.z);
+        }
+
+        result[i] = fmaxf(0.2126f * color.x + 0.7152f * color.y +
+                              0.0722f * color.z,
+                          0.f);
+      }
+    });
+
+    buffer->unmap(level);
+    return result;
+  }
+
+  virtual std::string key() const override {
+    return Param_Key("hdr") << fileName << (int)wrap << (int)filter;
+  }
+
+  // Identifies the image and its sampler settings
+  std::string samplerKey() const {
+    return Param_Key("hdr sampler") << fileName << (int)wrap << (int)filter;
+  }
+
   const std::string fileName;
+  const RTwrapmode wrap;
+  const RTfiltermode filter;
 };
 
 // Gradient Texture
@@ -234,7 +523,7 @@ struct Gradient_Texture : public Texture {
   Gradient_Texture(const float3 &cA, const float3 &cB, const float3 &cC)
       : colorA(cA), colorB(cB), colorC(cC) {}
 
-  virtual Program assignTo(Context &g_context) const override {
+  virtual Program create(Context &g_context) const override {
     Program textProg = createProgram(Gradient_PTX, "sample_texture", g_context);
 
     textProg["colorA"]->set3fv(&colorA.x);
@@ -244,6 +533,10 @@ struct Gradient_Texture : public Texture {
     return textProg;
   }
 
+  virtual std::string key() const override {
+    return Param_Key("gradient") << colorA << colorB << colorC;
+  }
+
   const float3 colorA;
   const float3 colorB;
   const float3 colorC;
@@ -253,7 +546,7 @@ struct Gradient_Texture : public Texture {
 struct Vector_Texture : public Texture {
   Vector_Texture(const std::vector<Texture *> &tv) : texture_vector(tv) {}
 
-  virtual Program assignTo(Context &g_context) const override {
+  virtual Program create(Context &g_context) const override {
     Program prog = createProgram(Vector_Tex_PTX, "sample_texture", g_context);
 
     std::vector<Program> programs;
@@ -267,6 +560,14 @@ struct Vector_Texture : public Texture {
     return prog;
   }
 
+  virtual std::string key() const override {
+    Param_Key params("vector");
+    for (int i = 0; i < texture_vector.size(); i++)
+      params << texture_vector[i]->key();
+
+    return params;
+  }
+
   const std::vector<Texture *> texture_vector;
 };
 
@@ -14,23 +14,63 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 
 // Host side constructors and functions
+#include "host_includes/blue_noise.hpp"
+#include "host_includes/checkpoint.hpp"
 #include "host_includes/gui.hpp"
 #include "host_includes/image_save.hpp"
 
-float renderFrame(Context &g_context, int Nx, int Ny) {
-  auto t0 = std::chrono::system_clock::now();
+// Traces the launch's samples with the wavefront integrator, one sample per
+// pixel at a time. Each bounce is a launch over the paths still alive, which
+// the previous launch compacted into a queue.
+void renderWaves(App_State &app, int frame, int Nx, int Ny) {
+  Context &g_context = app.context;
+  Buffer counter = g_context["alive_paths"]->getBuffer();
+
+  // the last launch might have less samples left to trace
+  int waves = std::min(app.samplesPerLaunch, app.samples - frame);
+
+  for (int wave = 0; wave < waves; wave++) {
+    g_context["wave"]->setInt(wave);
+    g_context->launch(GENERATE_PATHS, Nx, Ny);
+
+    // new paths are queued in the first queue
+    int queue = 0;
+    while (true) {
+      // read the paths queued by the last launch and reset the counter
+      unsigned int *count = (unsigned int *)counter->map();
+      unsigned int alive = *count;
+      *count = 0u;
+      counter->unmap();
+
+      if (alive == 0) break;
+
+      g_context["queue_in"]->setInt(queue);
+      g_context->launch(EXTEND_PATHS, (int)alive);
+      queue = 1 - queue;
+    }
 
-  // Validate settings
-  g_context->validate();
+    g_context->launch(ACCUMULATE_PATHS, Nx, Ny);
+  }
+}
+
+// Traces the samples of a launch, starting at the given one
+float renderFrame(App_State &app, int frame, int Nx, int Ny) {
+  auto t0 = std::chrono::system_clock::now();
+  app.context["frame"]->setInt(frame);
 
   // Launch ray generation program
-  g_context->launch(/*program ID:*/ 0, /*launch dimensions:*/ Nx, Ny);
+  if (app.wavefront && Nx * Ny > 0)
+    renderWaves(app, frame, Nx, Ny);
+  else
+    app.context->launch(/*program ID:*/ RENDER, /*launch dimensions:*/ Nx, Ny);
 
   auto t1 = std::chrono::system_clock::now();
   auto time = std::chrono::duration<float>(t1 - t0).count();
@@ -38,6 +78,11 @@ float renderFrame(Context &g_context, int Nx, int Ny) {
   return (float)time;
 }
 
+// Converts the acc buffer to the display buffer, for previews
+void tonemapFrame(Context &g_context, int Nx, int Ny) {
+  g_context->launch(/*program ID:*/ TONEMAP, /*launch dimensions:*/ Nx, Ny);
+}
+
 int Optix_Config(App_State &app) {
   // Set RTX global attribute(should be done before creating the context)
   if(app.RTX){
@@ -46,8 +91,7 @@ int Optix_Config(App_State &app) {
     res = rtGlobalSetAttribute(RT_GLOBAL_ATTRIBUTE_ENABLE_RTX, sizeof(RTX), &(RTX));
     if (res != RT_SUCCESS) {
       printf("Error: RTX mode is required for this application, exiting. \n");
-      system("PAUSE");
-      exit(0);
+      exitOnError();
     } else
       printf("OptiX RTX execution mode is ON.\n");
   }
@@ -58,6 +102,7 @@ int Optix_Config(App_State &app) {
 
   // Set number of samples
   app.context["samples"]->setInt(app.samples);
+  app.context["samples_per_launch"]->setInt(app.samplesPerLaunch);
 
   // Create and set the world
   switch (app.scene) {
@@ -82,23 +127,418 @@ int Optix_Config(App_State &app) {
       break;
 
     default:
-      throw "Selected scene is unknown";
+      printf("Error: scene %d is unknown.\n", app.scene);
+      exitOnError();
   }
 
+  // Frame buffers only need to hold a single tile in tiled renders
+  int bufferW = app.W, bufferH = app.H;
+  if (app.tileSize > 0) {
+    bufferW = std::min(app.tileSize, app.W);
+    bufferH = std::min(app.tileSize, app.H);
+  }
+  app.context["tile_offset"]->setUint(0u, 0u);
+  app.context["frame_size"]->setUint(app.W, app.H);
+
   // Create an output buffer
-  app.accBuffer = createFrameBuffer(app.W, app.H, app.context);
+  app.accBuffer = createFrameBuffer(bufferW, bufferH, app.context);
   app.context["acc_buffer"]->set(app.accBuffer);
 
-  // Create a display buffer
-  app.displayBuffer = createDisplayBuffer(app.W, app.H, app.context);
+  // Create a display buffer. Batch renders save straight from the acc buffer,
+  // so they don't need one.
+  if (batchMode)
+    app.displayBuffer = createDisplayBuffer(0, 0, app.context);
+  else
+    app.displayBuffer = createDisplayBuffer(bufferW, bufferH, app.context);
   app.context["display_buffer"]->set(app.displayBuffer);
 
-  printf("OptiX Building Time: %.2f\n", renderFrame(app.context, 0, 0));
+  // Random number sequence of the samples
+  app.context["sampler_type"]->setInt(app.sampler);
+  app.context["blue_noise"]->set(createBlueNoiseBuffer(app.context));
+
+  // Wavefront integrator state, one path per pixel of the frame buffer
+  if (app.wavefront) {
+    setWavefrontPrograms(app.context);
+    setExceptionProgram(app.context);
+    createPathBuffers(bufferW, bufferH, app.context);
+
+    // set for each launch by renderWaves
+    app.context["wave"]->setInt(0);
+    app.context["queue_in"]->setInt(0);
+  } else
+    createPathBuffers(1, 1, app.context);
+
+  // Adaptive sampling state. The moment buffer is only read when adaptive
+  // sampling is on, so a single element is enough otherwise.
+  app.context["noise_threshold"]->setFloat(app.noiseThreshold);
+  app.context["warmup_samples"]->setInt(app.warmupSamples);
+  if (app.noiseThreshold > 0.f)
+    app.momentBuffer = createFloatBuffer(bufferW, bufferH, app.context);
+  else
+    app.momentBuffer = createFloatBuffer(1, 1, app.context);
+  app.context["moment_buffer"]->set(app.momentBuffer);
+  app.activeBuffer = createCounterBuffer(app.context);
+  app.context["active_pixels"]->set(app.activeBuffer);
+
+  // Validate settings once. Later launches only change the frame number, so
+  // there's no need to validate the context again before each one of them.
+  app.context->validate();
+
+  printf("OptiX Building Time: %.2f\n", renderFrame(app, 0, 0, 0));
+
+  return 0;
+}
+
+// Returns how many pixels haven't converged in the last launch, and resets the
+// counter for the next one
+int Active_Pixels(App_State &app) {
+  unsigned int *counter = (unsigned int *)app.activeBuffer->map();
+  int active = *counter;
+  *counter = 0u;
+  app.activeBuffer->unmap();
+
+  return active;
+}
+
+// Checks if the render settings are valid, printing the invalid ones
+bool Check_Settings(App_State &app) {
+  if (app.W > 0 && app.H > 0 && app.samples > 0 && app.samplesPerLaunch > 0 &&
+      app.tileSize >= 0 && app.noiseThreshold >= 0.f &&
+      app.warmupSamples > 1 && app.timeBudget >= 0.f &&
+      (app.checkpointName.empty() || app.tileSize == 0) &&
+      app.frequency > 0 && app.previewInterval >= 0.f &&
+      app.sampler >= 0 && app.sampler <= 2)
+    return true;
+
+  printf("Selected settings are invalid:\n");
+
+  if (app.samples <= 0) printf("- 'samples' should be a positive integer.\n");
+
+  if (app.samplesPerLaunch <= 0)
+    printf("- 'samples per launch' should be a positive integer.\n");
+
+  if (app.W <= 0) printf("- 'width' should be a positive integer.\n");
+
+  if (app.H <= 0) printf("- 'height' should be a positive integer.\n");
+
+  if (app.tileSize < 0) printf("- 'tile size' can't be negative.\n");
+
+  if (app.noiseThreshold < 0.f)
+    printf("- 'noise threshold' can't be negative.\n");
+
+  if (app.warmupSamples <= 1)
+    printf("- 'warm-up samples' should be at least 2.\n");
+
+  if (app.timeBudget < 0.f) printf("- 'time budget' can't be negative.\n");
+
+  if (!app.checkpointName.empty() && app.tileSize > 0)
+    printf("- checkpoints aren't supported in tiled renders.\n");
+
+  if (app.frequency <= 0)
+    printf("- 'preview frequency' should be a positive integer.\n");
+
+  if (app.previewInterval < 0.f)
+    printf("- 'preview interval' can't be negative.\n");
+
+  if (app.sampler < 0 || app.sampler > 2)
+    printf("- 'sampler' should be 'random', 'sobol' or 'blue-noise'.\n");
+
+  printf("\n");
+
+  return false;
+}
+
+// Prints the command line options of the batch mode
+void Print_Usage(const char *program) {
+  printf("Usage: %s [options]\n", program);
+  printf("Renders without a window if any option is given.\n\n");
+  printf("  -s, --scene <id>     0 = In One Weekend, 1 = Moving Spheres,\n");
+  printf("                       2 = Cornell Box, 3 = Next Week final,\n");
+  printf("                       4 = Model Test Scene\n");
+  printf("  -m, --model <id>     model of the test scene: 0 = Placeholder,\n");
+  printf("                       1 = Lucy, 2 = Dragon, 3 = Spheres,\n");
+  printf("                       4 = Pie, 5 = Sponza\n");
+  printf("  -w, --width <px>     image width\n");
+  printf("  -h, --height <px>    image height\n");
+  printf("  -n, --samples <spp>  samples per pixel\n");
+  printf("  -b, --batch <spp>    samples per pixel traced by each launch\n");
+  printf("  -t, --tile <px>      render in square tiles of this size\n");
+  printf("                       (default: 0, whole frame per launch)\n");
+  printf("  -e, --error <e>      adaptive sampling, pixels stop once their\n");
+  printf("                       relative error is below e(e.g. 0.01)\n");
+  printf("  --warmup <spp>       samples before pixels can converge(default: "
+         "16)\n");
+  printf("  --time <seconds>     stop rendering after this long\n");
+  printf("  --checkpoint <file>  periodically save the render progress\n");
+  printf("  --checkpoint-interval <seconds>\n");
+  printf("                       time between checkpoints(default: 300)\n");
+  printf("  --resume <file>      continue the render saved in a checkpoint,\n");
+  printf("                       with the same settings or more samples\n");
+  printf("  --sampler <name>     random, sobol or blue-noise sequences\n");
+  printf("                       (default: sobol)\n");
+  printf("  --rtx <0|1>          toggle RTX execution mode\n");
+  printf("  --wavefront <0|1>    trace a launch per bounce, over the paths\n");
+  printf("                       still alive(default: 0)\n");
+  printf("  -o, --output <file>  .png or .hdr output file(default: out.png)\n");
+  printf("  --help               show this message\n");
+}
+
+// Parses command line arguments into the app state. Returns false if only
+// the usage was requested. Invalid arguments print the usage and exit.
+bool Parse_Args(int ac, char **av, App_State &app) {
+  for (int i = 1; i < ac; i++) {
+    const char *arg = av[i];
+
+    if (!strcmp(arg, "--help")) {
+      Print_Usage(av[0]);
+      return false;
+    }
+
+    // every other option takes a value
+    if (i + 1 >= ac) {
+      printf("Missing value for option '%s'.\n", arg);
+      Print_Usage(av[0]);
+      exitOnError();
+    }
+    const char *value = av[++i];
+
+    if (!strcmp(arg, "-s") || !strcmp(arg, "--scene")) {
+      app.scene = atoi(value);
+      if (app.scene < 0 || app.scene > 4) {
+        printf("Unknown scene '%s'.\n", value);
+        Print_Usage(av[0]);
+        exitOnError();
+      }
+    }
+
+    else if (!strcmp(arg, "-m") || !strcmp(arg, "--model"))
+      app.model = atoi(value);
+
+    else if (!strcmp(arg, "-w") || !strcmp(arg, "--width"))
+      app.W = atoi(value);
+
+    else if (!strcmp(arg, "-h") || !strcmp(arg, "--height"))
+      app.H = atoi(value);
+
+    else if (!strcmp(arg, "-n") || !strcmp(arg, "--samples"))
+      app.samples = atoi(value);
+
+    else if (!strcmp(arg, "-b") || !strcmp(arg, "--batch"))
+      app.samplesPerLaunch = atoi(value);
+
+    else if (!strcmp(arg, "-t") || !strcmp(arg, "--tile"))
+      app.tileSize = atoi(value);
+
+    else if (!strcmp(arg, "-e") || !strcmp(arg, "--error"))
+      app.noiseThreshold = (float)atof(value);
+
+    else if (!strcmp(arg, "--warmup"))
+      app.warmupSamples = atoi(value);
+
+    else if (!strcmp(arg, "--time"))
+      app.timeBudget = (float)atof(value);
+
+    else if (!strcmp(arg, "--checkpoint"))
+      app.checkpointName = value;
+
+    else if (!strcmp(arg, "--checkpoint-interval"))
+      app.saveInterval = (float)atof(value);
+
+    else if (!strcmp(arg, "--resume")) {
+      // progress keeps being saved to the same checkpoint
+      app.checkpointName = value;
+      app.resume = true;
+    }
+
+    else if (!strcmp(arg, "--sampler")) {
+      if (!strcmp(value, "random"))
+        app.sampler = 0;
+      else if (!strcmp(value, "sobol"))
+        app.sampler = 1;
+      else if (!strcmp(value, "blue-noise"))
+        app.sampler = 2;
+      else
+        app.sampler = -1;  // reported by Check_Settings
+    }
+
+    else if (!strcmp(arg, "--rtx"))
+      app.RTX = atoi(value) != 0;
+
+    else if (!strcmp(arg, "--wavefront"))
+      app.wavefront = atoi(value) != 0;
+
+    else if (!strcmp(arg, "-o") || !strcmp(arg, "--output")) {
+      // file type is given by the extension, which gets added back on save
+      std::string name(value);
+      size_t dot = name.find_last_of('.');
+      std::string ext = (dot == std::string::npos) ? "" : name.substr(dot);
+
+      if (ext == ".hdr" || ext == ".HDR") {
+        app.fileType = 1;
+        name = name.substr(0, dot);
+      } else if (ext == ".png" || ext == ".PNG") {
+        app.fileType = 0;
+        name = name.substr(0, dot);
+      }
+
+      app.fileName = name;
+    }
+
+    else {
+      printf("Unknown option '%s'.\n", arg);
+      Print_Usage(av[0]);
+      exitOnError();
+    }
+  }
+
+  return true;
+}
+
+// Checks if a render can stop before tracing all of its samples, because
+// every pixel converged or because it ran out of time
+bool Stop_Early(App_State &app, float renderTime, float timeBudget) {
+  if (app.noiseThreshold > 0.f && Active_Pixels(app) == 0) return true;
+
+  return timeBudget > 0.f && renderTime >= timeBudget;
+}
+
+// Saves a checkpoint, if the render has one, reporting failures
+void Checkpoint(App_State &app) {
+  if (app.checkpointName.empty()) return;
+
+  if (Save_Checkpoint(app, app.checkpointName))
+    printf("Saved checkpoint at sample %d.\n", app.currentSample);
+  else
+    printf("Failed to save checkpoint '%s'.\n", app.checkpointName.c_str());
+}
+
+// Renders the whole frame in each launch, starting from the current sample
+float Render_Frame(App_State &app, Image_Writer &writer) {
+  float renderTime = 0.f;
+  int progress = -1;
+  auto lastSave = std::chrono::steady_clock::now();
+  while (app.currentSample < app.samples) {
+    renderTime += renderFrame(app, app.currentSample, app.W, app.H);
+
+    // update number of rendered samples
+    app.currentSample += app.samplesPerLaunch;
+    app.currentSample = std::min(app.currentSample, app.samples);
+
+    if (Stop_Early(app, renderTime, app.timeBudget)) {
+      printf("Stopped at sample %d / %d\n", app.currentSample, app.samples);
+      break;
+    }
+
+    // periodically save progress
+    auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<float>(now - lastSave).count() >=
+        app.saveInterval) {
+      Checkpoint(app);
+      lastSave = now;
+    }
+
+    // print progress every 10%
+    int percent = (10 * app.currentSample) / app.samples;
+    if (percent != progress) {
+      progress = percent;
+      printf("sample = %d / %d\n", app.currentSample, app.samples);
+      fflush(stdout);
+    }
+  }
+
+  // a final checkpoint allows adding more samples later
+  Checkpoint(app);
+
+  writer.write(app.accBuffer);
+
+  return renderTime;
+}
+
+// Renders the frame one tile at a time, streaming each finished tile to the
+// image writer. Launches stay short and device buffers only hold one tile.
+float Render_Tiles(App_State &app, Image_Writer &writer) {
+  int tileW = std::min(app.tileSize, app.W);
+  int tileH = std::min(app.tileSize, app.H);
+  int numTiles = ((app.W + tileW - 1) / tileW) * ((app.H + tileH - 1) / tileH);
+
+  // the time budget is split evenly between tiles
+  float tileBudget = app.timeBudget / numTiles;
+
+  float renderTime = 0.f;
+  int tile = 0;
+  for (int y = 0; y < app.H; y += tileH)
+    for (int x = 0; x < app.W; x += tileW) {
+      // tiles on the borders might be smaller
+      int w = std::min(tileW, app.W - x);
+      int h = std::min(tileH, app.H - y);
+      app.context["tile_offset"]->setUint(x, y);
+
+      float tileTime = 0.f;
+      for (int s = 0; s < app.samples; s += app.samplesPerLaunch) {
+        tileTime += renderFrame(app, s, w, h);
+
+        if (Stop_Early(app, tileTime, tileBudget)) break;
+      }
+      renderTime += tileTime;
+
+      // launch rows are bottom to top, while buffer rows are top to bottom
+      const float4 *cols = (const float4 *)app.accBuffer->map();
+      writer.write(cols, tileW, x, app.H - y - h, w, h);
+      app.accBuffer->unmap();
+
+      printf("tile = %d / %d\n", ++tile, numTiles);
+      fflush(stdout);
+    }
+
+  app.currentSample = app.samples;
+
+  return renderTime;
+}
+
+// Renders the whole image without a window or GUI, and saves it to disk
+int Batch_Render(App_State &app) {
+  if (!Check_Settings(app)) return 1;
+
+  // Configure OptiX context & scene
+  Optix_Config(app);
+
+  if (app.resume) {
+    if (!Load_Checkpoint(app, app.checkpointName)) return 1;
+    printf("Resuming from sample %d.\n", app.currentSample);
+  }
+
+  // Output format is selected in the command line
+  Image_Writer writer(app, app.fileType);
+
+  float renderTime;
+  if (app.tileSize > 0)
+    renderTime = Render_Tiles(app, writer);
+  else
+    renderTime = Render_Frame(app, writer);
+
+  printf("Done rendering, output file will be saved.\n");
+  printf("Render time: %.2fs\n", renderTime);
+
+  if (!writer.save()) {
+    printf("Failed to save output file '%s'.\n", app.fileName.c_str());
+    return 1;
+  }
 
   return 0;
 }
 
 int main(int ac, char **av) {
+  // Any command line option means we should render without a window
+  if (ac > 1) {
+    batchMode = true;
+
+    App_State app;
+    // asking for the usage isn't an error
+    if (!Parse_Args(ac, av, app)) return 0;
+
+    return Batch_Render(app);
+  }
+
   ImVec4 clear_color = ImVec4(0.43f, 0.43f, 0.43f, 1.00f);
 
   // Setup window
@@ -165,9 +605,11 @@ int main(int ac, char **av) {
   ImGui_ImplOpenGL3_Init(glsl_version);
 
   float Hf, Wf;
-  uchar1 *imageData;
+  Preview preview;
   App_State app;
   float renderTime = 0.f;
+  int launchesSincePreview = 0;
+  auto lastPreview = std::chrono::steady_clock::now();
   while (!glfwWindowShouldClose(window)) {
     glfwPollEvents();
 
@@ -185,8 +627,30 @@ int main(int ac, char **av) {
         ImGui::InputInt("Height", &app.H, 1, 100);
 
         ImGui::InputInt("Samples Per Pixel", &app.samples, 1, 100);
+        ImGui::InputInt("Samples Per Launch", &app.samplesPerLaunch, 1, 10);
+        ImGui::SameLine();
+        ShowHelpMarker("Higher values render faster, but update the preview "
+                       "less often.");
+
+        ImGui::InputFloat("Noise Threshold", &app.noiseThreshold, 0.001f,
+                          0.01f, "%.3f");
+        ImGui::SameLine();
+        ShowHelpMarker("Pixels stop sampling once their relative error is "
+                       "below this value. Zero samples every pixel equally.");
         
+        ImGui::Combo("Sampler", &app.sampler, "Random\0Sobol\0Blue Noise\0");
+        ImGui::SameLine();
+        ShowHelpMarker("Sobol sequences spread the samples of each pixel more "
+                       "evenly, so images converge in fewer samples. Blue "
+                       "noise also spreads the error between neighboring "
+                       "pixels, so previews look smoother at low sample "
+                       "counts.");
+
         ImGui::Checkbox("RTX Mode", &app.RTX);
+        ImGui::Checkbox("Wavefront", &app.wavefront);
+        ImGui::SameLine();
+        ShowHelpMarker("Traces each bounce in its own launch, compacting the "
+                       "paths that are still alive in between.");
 
         ImGui::Combo("Scene", &app.scene,
                      "Peter Shirley's In One Weekend\0Peter Shirley's The Next "
@@ -199,6 +663,16 @@ int main(int ac, char **av) {
                        "Dragon\0Spheres\0Pie\0Sponza\0");
 
         ImGui::Checkbox("Show Progress", &app.showProgress);
+        if (app.showProgress) {
+          ImGui::InputInt("Preview Frequency", &app.frequency, 1, 10);
+          ImGui::SameLine();
+          ShowHelpMarker("Number of launches between preview updates.");
+          ImGui::InputFloat("Preview Interval", &app.previewInterval, 0.05f,
+                            0.5f, "%.2f");
+          ImGui::SameLine();
+          ShowHelpMarker("Minimum time between preview updates, in seconds. "
+                         "Reading the image back slows the render down.");
+        }
 
         ImGui::Text("Save as:");
         ImGui::InputText("Filename", &app.fileName, 0, 0, 0);
@@ -208,7 +682,7 @@ int main(int ac, char **av) {
 
         // check if render button has been pressed
         if (ImGui::Button("Render")) {
-          if (app.W > 0 && app.H > 0 && app.samples > 0) {
+          if (Check_Settings(app)) {
             // Configure OptiX context & scene
             Optix_Config(app);
 
@@ -230,21 +704,8 @@ int main(int ac, char **av) {
               Hf = app.H * 1.f;
             }
 
-            // allocate preview array
-            imageData = (uchar1 *)malloc(app.W * app.H * sizeof(uchar4));
-          } else {
-            printf("Selected settings are invalid:\n");
-
-            if (app.samples <= 0)
-              printf("- 'samples' should be a positive integer.\n");
-
-            if (app.W <= 0)
-              printf("- 'width' should be a positive integer.\n");
-
-            if (app.H <= 0)
-              printf("- 'height' should be a positive integer.\n");
-
-            printf("\n");
+            // create preview texture
+            if (app.showProgress) preview.init(app.W, app.H);
           }
         }
       }
@@ -255,14 +716,21 @@ int main(int ac, char **av) {
         ImGui::Begin("Progress");
 
         // render a frame
-        app.context["frame"]->setInt(app.currentSample);
-        renderTime += renderFrame(app.context, app.W, app.H);
-
-        // copy stream buffer content
-        if (app.showProgress) {
-          uchar1 *copyArr = (uchar1 *)app.displayBuffer->map();
-          memcpy(imageData, copyArr, app.W * app.H * sizeof(uchar4));
-          app.displayBuffer->unmap();
+        renderTime += renderFrame(app, app.currentSample, app.W, app.H);
+
+        // finish right away if every pixel has converged
+        bool converged = app.noiseThreshold > 0.f && Active_Pixels(app) == 0;
+
+        // stream display buffer to the preview, if it's time to update it
+        launchesSincePreview++;
+        auto now = std::chrono::steady_clock::now();
+        float elapsed = std::chrono::duration<float>(now - lastPreview).count();
+        if (app.showProgress && launchesSincePreview >= app.frequency &&
+            elapsed >= app.previewInterval) {
+          tonemapFrame(app.context, app.W, app.H);
+          preview.update(app.displayBuffer);
+          launchesSincePreview = 0;
+          lastPreview = now;
         }
 
         ImGui::Text("sample = %d / %d", app.currentSample, app.samples);
@@ -273,18 +741,31 @@ int main(int ac, char **av) {
         // check if cancel button has been pressed
         if (ImGui::Button("Cancel")) {
           // destroy window & opengl state
+          preview.destroy();
           glfwDestroyWindow(window);
           glfwTerminate();
 
-          printf(
-              "Rendering has been canceled, output file will not be saved.\n");
+          // keep the progress, so the render can be resumed later. This
+          // frame's launch has already been traced.
+          app.currentSample += app.samplesPerLaunch;
+          app.currentSample = std::min(app.currentSample, app.samples);
+          app.checkpointName = app.fileName + ".ckpt";
+          if (Save_Checkpoint(app, app.checkpointName))
+            printf("Rendering has been canceled, resume it with the same "
+                   "settings and '--resume %s'.\n",
+                   app.checkpointName.c_str());
+          else
+            printf("Rendering has been canceled, output file will not be "
+                   "saved.\n");
           system("PAUSE");
 
           return 0;
         }
 
         // update number of rendered samples
-        app.currentSample++;
+        app.currentSample += app.samplesPerLaunch;
+        app.currentSample = std::min(app.currentSample, app.samples);
+        if (converged) app.currentSample = app.samples;
       }
 
       ImGui::End();
@@ -296,21 +777,9 @@ int main(int ac, char **av) {
     if (app.showProgress && app.start) {
       ImGui::Begin("Render Preview");
 
-      GLuint textureId;
-      glGenTextures(1, &textureId);
-      glBindTexture(GL_TEXTURE_2D, textureId);
-
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, app.W, app.H, 0, GL_RGBA,
-                   GL_UNSIGNED_BYTE, imageData);
-
       // display progress
-      ImGui::Image((void *)(intptr_t)textureId, ImVec2(Wf, Hf));
+      ImGui::Image((void *)(intptr_t)preview.texture, ImVec2(Wf, Hf));
       ImGui::End();
-
-      glBindTexture(GL_TEXTURE_2D, 0);
     }
 
     // Render GUI frame
@@ -347,6 +816,7 @@ int main(int ac, char **av) {
     if (app.done) break;
   }
 
+  preview.destroy();
   glfwDestroyWindow(window);
   glfwTerminate();
 
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "vec.hpp"
+
+// Maps a direction to equirectangular texture coordinates. v goes from +Y
+// to -Y, u starts at +X for spherical maps and at +Z for cylindrical ones.
+RT_FUNCTION float2 Environment_UV(const float3 &direction, bool isSpherical) {
+  float3 dir = normalize(direction);
+  float v = acosf(fminf(fmaxf(dir.y, -1.f), 1.f)) / PI_F;
+
+  // spherical HDRI mapping
+  // https://www.gamedev.net/forums/topic/637220-equirectangular-environment-map/
+  if (isSpherical) return make_float2(atan2f(dir.z, dir.x) / (2.f * PI_F), v);
+
+  // cylindrical HDRI mapping, wrap around full circle if negative
+  float theta = atan2f(dir.x, dir.z);
+  theta = theta < 0.f ? theta + (2.f * PI_F) : theta;
+
+  return make_float2(1.f - (theta / (2.f * PI_F)), v);
+}
+
+// Inverse of Environment_UV, returns a unit direction
+RT_FUNCTION float3 Environment_Direction(float u, float v, bool isSpherical) {
+  float sinTheta = sinf(PI_F * v), cosTheta = cosf(PI_F * v);
+
+  if (isSpherical) {
+    float phi = 2.f * PI_F * u;
+    return make_float3(sinTheta * cosf(phi), cosTheta, sinTheta * sinf(phi));
+  }
+
+  float phi = 2.f * PI_F * (1.f - u);
+  return make_float3(sinTheta * sinf(phi), cosTheta, sinTheta * cosf(phi));
+}
@@ -81,23 +81,29 @@ RT_CALLABLE_PROGRAM HitRecord Get_HitRecord(int index,    // primitive index
   float3 hit_point = ray.origin + t_hit * ray.direction;
   rec.P = rtTransformPoint(RT_OBJECT_TO_WORLD, hit_point);
 
-  // Get normal and texture coordinates depending on axis
-  float3 normal;
+  // Get normal, texture coordinates and edges depending on axis
+  float3 normal, edgeA, edgeB;
   switch (AXIS(axis)) {
     case X_AXIS:
       normal = make_float3(1.f, 0.f, 0.f);
       rec.u = (hit_point.y - a0) / (a1 - a0);
       rec.v = (hit_point.z - b0) / (b1 - b0);
+      edgeA = make_float3(0.f, a1 - a0, 0.f);
+      edgeB = make_float3(0.f, 0.f, b1 - b0);
       break;
     case Y_AXIS:
       normal = make_float3(0.f, 1.f, 0.f);
       rec.u = (hit_point.x - a0) / (a1 - a0);
       rec.v = (hit_point.z - b0) / (b1 - b0);
+      edgeA = make_float3(a1 - a0, 0.f, 0.f);
+      edgeB = make_float3(0.f, 0.f, b1 - b0);
       break;
     case Z_AXIS:
       normal = make_float3(0.f, 0.f, 1.f);
       rec.u = (hit_point.x - a0) / (a1 - a0);
       rec.v = (hit_point.y - b0) / (b1 - b0);
+      edgeA = make_float3(a1 - a0, 0.f, 0.f);
+      edgeB = make_float3(0.f, b1 - b0, 0.f);
       break;
     default:
       printf("Error: invalid axis");
@@ -111,6 +117,12 @@ RT_CALLABLE_PROGRAM HitRecord Get_HitRecord(int index,    // primitive index
   // Texture Index
   rec.index = index;
 
+  // texcoord change per world unit, the rect spans a unit of uv area
+  float3 w1 = rtTransformVector(RT_OBJECT_TO_WORLD, edgeA);
+  float3 w2 = rtTransformVector(RT_OBJECT_TO_WORLD, edgeB);
+  float worldArea = length(cross(w1, w2));
+  rec.texScale = worldArea > 0.f ? 1.f / sqrtf(worldArea) : 0.f;
+
   return rec;
 }
 
@@ -84,6 +84,7 @@ RT_CALLABLE_PROGRAM HitRecord Get_HitRecord(int index,    // primitive index
 
   // Texture coordinates
   rec.u = rec.v = 0.f;
+  rec.texScale = 0.f;
 
   // Texture Index
   rec.index = index;
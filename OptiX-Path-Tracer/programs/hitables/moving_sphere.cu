@@ -42,6 +42,11 @@ RT_FUNCTION void get_sphere_uv(const float3& p) {
 
   hit_rec.u = 1 - (phi + PI_F) / (2 * PI_F);
   hit_rec.v = (theta + PI_F / 2) / PI_F;
+
+  // texcoord change per world unit, averaged over the sphere
+  float worldRadius =
+      length(rtTransformVector(RT_OBJECT_TO_WORLD, make_float3(radius, 0, 0)));
+  hit_rec.texScale = 1.f / (2.f * sqrtf(PI_F) * worldRadius);
 }
 
 RT_FUNCTION float3 center(float time) {
@@ -86,6 +86,11 @@ RT_CALLABLE_PROGRAM HitRecord Get_HitRecord(int index,    // primitive index
   rec.u = 1.f - (phi + PI_F) / (2.f * PI_F);
   rec.v = (theta + PI_F / 2.f) / PI_F;
 
+  // texcoord change per world unit, averaged over the sphere
+  float worldRadius =
+      length(rtTransformVector(RT_OBJECT_TO_WORLD, make_float3(radius, 0, 0)));
+  rec.texScale = 1.f / (2.f * sqrtf(PI_F) * worldRadius);
+
   // Texture Index
   rec.index = index;
 
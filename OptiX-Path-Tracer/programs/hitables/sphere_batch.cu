@@ -0,0 +1,113 @@
+// ======================================================================== //
+// Copyright 2018 Ingo Wald                                                 //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#include "../prd.cuh"
+#include "hitables.cuh"
+
+// OptiX Context objects
+rtDeclareVariable(Ray, ray, rtCurrentRay, );
+
+// Intersected Geometry Attributes
+rtDeclareVariable(int, geo_index, attribute geo_index, );  // primitive index
+rtDeclareVariable(float2, bc, attribute bc, );  // triangle barycentrics
+
+// Primitive Parameters
+rtBuffer<float4> sphere_buffer;  // center in xyz, radius in w
+rtBuffer<int> material_buffer;   // material index of each sphere
+
+// Checks if Ray intersects the pid-th Sphere and computes hit distance
+RT_PROGRAM void hit_sphere(int pid) {
+  const float4 sphere = sphere_buffer[pid];
+  const float3 center = make_float3(sphere.x, sphere.y, sphere.z);
+  const float radius = sphere.w;
+
+  const float3 oc = ray.origin - center;
+
+  // Using Bhaskara's Formula, as in sphere.cu
+  const float a = dot(ray.direction, ray.direction);
+  const float b = dot(oc, ray.direction);
+  const float c = dot(oc, oc) - radius * radius;
+  const float discriminant = b * b - a * c;
+
+  // if the discriminant is lower than zero, there's no real
+  // solution and thus no hit
+  if (discriminant < 0.f) return;
+
+  // first root of the sphere equation:
+  float t = (-b - sqrtf(discriminant)) / a;
+  if (rtPotentialIntersection(t)) {
+    geo_index = pid;
+    bc = make_float2(0);
+    rtReportIntersection(material_buffer[pid]);
+  }
+
+  t = (-b + sqrtf(discriminant)) / a;
+  if (rtPotentialIntersection(t)) {
+    geo_index = pid;
+    bc = make_float2(0);
+    rtReportIntersection(material_buffer[pid]);
+  }
+}
+
+// Gets HitRecord parameters, given a ray, an index and a hit distance
+RT_CALLABLE_PROGRAM HitRecord Get_HitRecord(int index,    // primitive index
+                                            Ray ray,      // current ray
+                                            float t_hit,  // intersection dist
+                                            float2 bc) {  // barycentrics
+  const float4 sphere = sphere_buffer[index];
+  const float3 center = make_float3(sphere.x, sphere.y, sphere.z);
+  const float radius = sphere.w;
+
+  HitRecord rec;
+
+  // view direction
+  rec.Wo = normalize(-ray.direction);
+
+  // Hit Point
+  float3 hit_point = ray.origin + t_hit * ray.direction;
+  rec.P = rtTransformPoint(RT_OBJECT_TO_WORLD, hit_point);
+
+  // Normal
+  float3 T = (hit_point - center) / radius;
+  float3 normal = normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, T));
+  rec.shading_normal = rec.geometric_normal = normal;
+
+  // Texture coordinates
+  float phi = atan2(T.z, T.x);
+  float theta = asin(T.y);
+  rec.u = 1.f - (phi + PI_F) / (2.f * PI_F);
+  rec.v = (theta + PI_F / 2.f) / PI_F;
+
+  // texcoord change per world unit, averaged over the sphere
+  float worldRadius =
+      length(rtTransformVector(RT_OBJECT_TO_WORLD, make_float3(radius, 0, 0)));
+  rec.texScale = 1.f / (2.f * sqrtf(PI_F) * worldRadius);
+
+  // Texture Index, each sphere has a material of its own
+  rec.index = 0;
+
+  return rec;
+}
+
+// Computes bounding box attributes of the pid-th Sphere
+RT_PROGRAM void get_bounds(int pid, float result[6]) {
+  const float4 sphere = sphere_buffer[pid];
+  const float3 center = make_float3(sphere.x, sphere.y, sphere.z);
+
+  Aabb* aabb = (Aabb*)result;
+  aabb->m_min = center - sphere.w;
+  aabb->m_max = center + sphere.w;
+}
@@ -133,6 +133,7 @@ RT_CALLABLE_PROGRAM HitRecord Get_HitRecord(int index,    // primitive index
   if (texcoord_buffer.size() == 0) {
     rec.u = 0.f;
     rec.v = 0.f;
+    rec.texScale = 0.f;
   } else {
     float2 a_uv = texcoord_buffer[v_idx.x];
     float2 b_uv = texcoord_buffer[v_idx.y];
@@ -140,6 +141,14 @@ RT_CALLABLE_PROGRAM HitRecord Get_HitRecord(int index,    // primitive index
 
     rec.u = a_uv.x * b0 + b_uv.x * b1 + c_uv.x * b2;
     rec.v = a_uv.y * b0 + b_uv.y * b1 + c_uv.y * b2;
+
+    // texcoord change per world unit, from the texcoord and world areas
+    float2 uv1 = b_uv - a_uv, uv2 = c_uv - a_uv;
+    float uvArea = fabsf(uv1.x * uv2.y - uv1.y * uv2.x);
+    float3 w1 = rtTransformVector(RT_OBJECT_TO_WORLD, b - a);
+    float3 w2 = rtTransformVector(RT_OBJECT_TO_WORLD, c - a);
+    float worldArea = length(cross(w1, w2));
+    rec.texScale = worldArea > 0.f ? sqrtf(uvArea / worldArea) : 0.f;
   }
 
   // Texture Index
@@ -56,7 +56,7 @@ RT_PROGRAM void hit_volume(int pid) {
       float distance_inside_boundary = rec2 - rec1;
       distance_inside_boundary *= length(ray.direction);
 
-      float hit_distance = -(1.f / density) * log(rnd(prd.seed));
+      float hit_distance = -(1.f / density) * log(rnd(prd.sampler));
       float temp = rec1 + hit_distance / length(ray.direction);
 
       if (rtPotentialIntersection(temp)) {
@@ -75,6 +75,7 @@ RT_PROGRAM void hit_volume(int pid) {
 
         hit_rec.u = 0.f;
         hit_rec.v = 0.f;
+        hit_rec.texScale = 0.f;
 
         hit_rec.index = index;
 
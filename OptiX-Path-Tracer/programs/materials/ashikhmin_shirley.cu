@@ -17,7 +17,6 @@
 // OptiX Context objects
 rtDeclareVariable(Ray, ray, rtCurrentRay, );                // current ray
 rtDeclareVariable(PerRayData, prd, rtPayload, );            // ray PRD
-rtDeclareVariable(rtObject, world, , );                     // scene graph
 rtDeclareVariable(float, t_hit, rtIntersectionDistance, );  // hit distance
 
 // Intersected Geometry Parameters
@@ -33,11 +32,12 @@ rtDeclareVariable(float, nv, , );
 
 RT_FUNCTION Ashikhmin_Shirley_Parameters Get_Parameters(const float3 &P,
                                                         float u, float v,
-                                                        int index) {
+                                                        int index,
+                                                        float footprint) {
   Ashikhmin_Shirley_Parameters surface;
 
-  surface.diffuse_color = diffuse_color(u, v, P, index);
-  surface.specular_color = specular_color(u, v, P, index);
+  surface.diffuse_color = diffuse_color(u, v, P, index, footprint);
+  surface.specular_color = specular_color(u, v, P, index, footprint);
   surface.nu = nu;
   surface.nv = nv;
 
@@ -51,11 +51,13 @@ RT_PROGRAM void closest_hit() {
   float3 P = rec.P;               // Hit Point
   float3 Wo = rec.Wo;             // Ray view direction
   float3 N = rec.shading_normal;  // normal
+  float footprint = Texture_Footprint(prd, rec, t_hit);  // texture filter
 
-  Ashikhmin_Shirley_Parameters surface = Get_Parameters(P, rec.u, rec.v, index);
+  Ashikhmin_Shirley_Parameters surface =
+      Get_Parameters(P, rec.u, rec.v, index, footprint);
 
   // Sample BRDF
-  float3 Wi = Sample(surface, P, Wo, N, prd.seed);
+  float3 Wi = Sample(surface, P, Wo, N, prd.sampler);
   float pdf;  // calculated in the Evaluate function
   float3 attenuation = Evaluate(surface, P, Wo, Wi, N, pdf);
 
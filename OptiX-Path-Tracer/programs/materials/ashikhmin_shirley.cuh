@@ -12,7 +12,7 @@ RT_FUNCTION float3 Sample(const Ashikhmin_Shirley_Parameters &surface,
                           const float3 &P,   // next ray origin
                           const float3 &Wo,  // prev ray direction
                           const float3 &Ns,  // shading normal
-                          uint &seed) {
+                          Sampler &sampler) {
   // Get material params from input variable
   float nu = surface.nu;
   float nv = surface.nv;
@@ -25,7 +25,7 @@ RT_FUNCTION float3 Sample(const Ashikhmin_Shirley_Parameters &surface,
   float3 B = cross(T, N);
 
   // random variables
-  float2 random = make_float2(rnd(seed), rnd(seed));
+  float2 random = make_float2(rnd(sampler), rnd(sampler));
 
   if (random.x < 0.5) {
     // sample diffuse term
@@ -49,8 +49,9 @@ RT_PROGRAM void closest_hit() {
   float3 P = rec.P;               // Hit Point
   float3 Wo = -rec.Wo;            // Ray view direction
   float3 N = rec.shading_normal;  // normal
+  float footprint = Texture_Footprint(prd, rec, t_hit);  // texture filter
 
-  float3 base_color = base_texture(rec.u, rec.v, P, index);
+  float3 base_color = base_texture(rec.u, rec.v, P, index, footprint);
   float3 absorption = make_float3(1.f);
 
   float ni_over_nt;
@@ -63,7 +64,7 @@ RT_PROGRAM void closest_hit() {
     cosine = ref_idx * cosine / length(Wo);
 
     // Apply the Beer-Lambert Law
-    float3 extinction = extinction_texture(rec.u, rec.v, P, index);
+    float3 extinction = extinction_texture(rec.u, rec.v, P, index, footprint);
     // absorption = expf(-t_hit * extinction);
   }
 
@@ -82,7 +83,7 @@ RT_PROGRAM void closest_hit() {
     reflect_prob = 1.f;
 
   // Ray should be reflected...
-  if (rnd(prd.seed) < reflect_prob) prd.direction = reflect(Wo, N);
+  if (rnd(prd.sampler) < reflect_prob) prd.direction = reflect(Wo, N);
 
   // ...or refracted
   else
@@ -7,7 +7,6 @@
 // OptiX Context objects
 rtDeclareVariable(Ray, ray, rtCurrentRay, );                // current ray
 rtDeclareVariable(PerRayData, prd, rtPayload, );            // ray PRD
-rtDeclareVariable(rtObject, world, , );                     // scene graph
 rtDeclareVariable(float, t_hit, rtIntersectionDistance, );  // hit distance
 
 // Intersected Geometry Parameters
@@ -19,10 +18,11 @@ rtDeclareVariable(float2, bc, attribute bc, );  // triangle barycentrics
 rtDeclareVariable(Texture_Function, sample_texture, , );
 
 RT_FUNCTION Diffuse_Light_Parameters Get_Parameters(const float3 &P, float u,
-                                                    float v, int index) {
+                                                    float v, int index,
+                                                    float footprint) {
   Diffuse_Light_Parameters surface;
 
-  surface.color = sample_texture(u, v, P, index);
+  surface.color = sample_texture(u, v, P, index, footprint);
 
   return surface;
 }
@@ -33,11 +33,13 @@ RT_PROGRAM void closest_hit() {
   float3 P = rec.P;               // Hit Point
   float3 Wo = rec.Wo;             // Ray view direction
   float3 N = rec.shading_normal;  // normal
+  float footprint = Texture_Footprint(prd, rec, t_hit);  // texture filter
 
-  Diffuse_Light_Parameters surface = Get_Parameters(P, rec.u, rec.v, index);
+  Diffuse_Light_Parameters surface =
+      Get_Parameters(P, rec.u, rec.v, index, footprint);
 
   // Sample Direct Light
-  float3 direct = Direct_Light(surface, P, Wo, N, true, prd.seed);
+  float3 direct = Direct_Light(surface, P, Wo, N, true, prd.sampler);
   prd.radiance += prd.throughput * direct;
 
   // Take Light emission into account
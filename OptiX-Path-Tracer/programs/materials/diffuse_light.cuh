@@ -8,8 +8,8 @@ RT_FUNCTION float3 Sample(const Diffuse_Light_Parameters &surface,
                           const float3 &P,   // next ray origin
                           const float3 &Wo,  // prev ray direction
                           const float3 &N,   // shading normal
-                          uint &seed) {
-  return random_on_unit_sphere(seed);
+                          Sampler &sampler) {
+  return random_on_unit_sphere(sampler);
 }
 
 RT_FUNCTION float3 Evaluate(const Diffuse_Light_Parameters &surface,
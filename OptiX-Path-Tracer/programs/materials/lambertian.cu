@@ -23,7 +23,6 @@
 // OptiX Context objects
 rtDeclareVariable(Ray, ray, rtCurrentRay, );                // current ray
 rtDeclareVariable(PerRayData, prd, rtPayload, );            // ray PRD
-rtDeclareVariable(rtObject, world, , );                     // scene graph
 rtDeclareVariable(float, t_hit, rtIntersectionDistance, );  // hit distance
 
 // Intersected Geometry Attributes
@@ -37,10 +36,11 @@ rtDeclareVariable(Texture_Function, sample_texture, , );
 RT_FUNCTION Lambertian_Parameters Get_Parameters(const float3 &P,  // hit point
                                                  float u,  // texture coord x
                                                  float v,  // texture coord y
-                                                 int index) {  // texture index
+                                                 int index,  // texture index
+                                                 float footprint) {
   Lambertian_Parameters surface;
 
-  surface.color = sample_texture(u, v, P, index);
+  surface.color = sample_texture(u, v, P, index, footprint);
 
   return surface;
 }
@@ -52,15 +52,17 @@ RT_PROGRAM void closest_hit() {
   float3 P = rec.P;               // Hit Point
   float3 Wo = rec.Wo;             // Ray view direction
   float3 N = rec.shading_normal;  // normal
+  float footprint = Texture_Footprint(prd, rec, t_hit);  // texture filter
 
-  Lambertian_Parameters surface = Get_Parameters(P, rec.u, rec.v, index);
+  Lambertian_Parameters surface =
+      Get_Parameters(P, rec.u, rec.v, index, footprint);
 
   // Sample Direct Light
-  float3 direct = Direct_Light(surface, P, Wo, N, false, prd.seed);
+  float3 direct = Direct_Light(surface, P, Wo, N, false, prd.sampler);
   prd.radiance += prd.throughput * direct;
 
   // Sample BRDF
-  float3 Wi = Sample(surface, P, Wo, N, prd.seed);
+  float3 Wi = Sample(surface, P, Wo, N, prd.sampler);
   float pdf;  // calculated in the Evaluate function
   float3 attenuation = Evaluate(surface, P, Wo, Wi, N, pdf);
 
@@ -8,9 +8,9 @@ RT_FUNCTION float3 Sample(const Lambertian_Parameters &surface,
                           const float3 &P,   // next ray origin
                           const float3 &Wo,  // prev ray direction
                           const float3 &N,   // shading normal
-                          uint &seed) {
+                          Sampler &sampler) {
   float3 Wi;
-  cosine_sample_hemisphere(rnd(seed), rnd(seed), Wi);
+  cosine_sample_hemisphere(rnd(sampler), rnd(sampler), Wi);
 
   Onb uvw(N);
   uvw.inverse_transform(Wi);
@@ -9,13 +9,17 @@
 #include "oren_nayar.cuh"
 #include "torrance_sparrow.cuh"
 
-// Light sampling callable programs
+rtDeclareVariable(rtObject, world, , );  // scene graph, for shadow rays
+
+// Light sampling callable programs. Samples return the vector from P to
+// the sampled point, or a unit direction for lights at infinity, and its PDF.
 rtDeclareVariable(int, numLights, , );
 rtBuffer<float3> Light_Emissions;
 rtBuffer<rtCallableProgramId<float3(const float3 &,  // P
                                     const float3 &,  // Wo
                                     const float3 &,  // N
-                                    uint &)>>        // rnd seed
+                                    Sampler &,       // sampler
+                                    float &)>>       // sample PDF
     Light_Sample;
 
 rtBuffer<rtCallableProgramId<float(const float3 &,    // P
@@ -24,6 +28,52 @@ rtBuffer<rtCallableProgramId<float(const float3 &,    // P
                                    const float3 &)>>  // N
     Light_PDF;
 
+// Mesh lights can't be found by BSDF samples, they're only light sampled
+rtBuffer<int> Light_Is_Mesh;
+
+// Light selection alias table, lights are picked proportionally to power
+rtBuffer<float> Light_Threshold;
+rtBuffer<int> Light_Alias;
+rtBuffer<float> Light_Selection_PDF;
+
+// Picks a light and returns the probability of picking it
+RT_FUNCTION int Pick_Light(Sampler &sampler, float &selectionPDF) {
+  float x = rnd(sampler) * numLights;
+  int index = min((int)x, numLights - 1);
+  if (x - index >= Light_Threshold[index]) index = Light_Alias[index];
+
+  selectionPDF = Light_Selection_PDF[index];
+  return index;
+}
+
+// Environment map light, its radiance depends on the direction
+rtDeclareVariable(int, Environment_Light, , );  // light index, -1 if none
+rtBuffer<rtCallableProgramId<float3(const float3 &)>> Environment_Radiance;
+
+// Emission of a light towards a direction
+RT_FUNCTION float3 Light_Emission(int index, const float3 &Wi) {
+  if (index == Environment_Light)
+    return Light_Emissions[index] * Environment_Radiance[0](Wi);
+
+  return Light_Emissions[index];
+}
+
+// Checks if anything blocks a shadow ray before tmax
+RT_FUNCTION bool Occluded(const float3 &P, const float3 &Wi, const float3 &N,
+                          float tmax) {
+  PerRayData_Shadow prdShadow;
+  prdShadow.inShadow = false;
+  prdShadow.normal = N;
+  Ray shadowRay = make_Ray(/* origin   : */ P,
+                           /* direction: */ normalize(Wi),
+                           /* ray type : */ 1,
+                           /* tmin     : */ 1e-3f,
+                           /* tmax     : */ tmax);
+  rtTrace(world, shadowRay, prdShadow);
+
+  return prdShadow.inShadow;
+}
+
 RT_FUNCTION float PowerHeuristic(unsigned int numf, float fPdf,
                                  unsigned int numg, float gPdf) {
   float f = numf * fPdf;
@@ -37,69 +87,70 @@ RT_FUNCTION float3 Direct_Light(T &surface,        // surface parameters
                                 const float3 &P,   // next ray origin
                                 const float3 &Wo,  // previous ray direction
                                 const float3 &N,   // surface normal
-                                bool isLight, uint &seed) {
+                                bool isLight, Sampler &sampler) {
   float3 directLight = make_float3(0.f);
 
   // return black if there's no light
   if (numLights == 0) return make_float3(0.f);
 
-  // ramdomly pick one light and multiply the result by the number of lights
-  // it's the same as dividing by the PDF if they have the same probability
-  int index = ((int)(rnd(seed) * numLights)) % numLights;
+  // pick one light and divide the result by the probability of picking it,
+  // MIS weights use the combined selection and light PDF
+  float selectionPDF;
+  int index = Pick_Light(sampler, selectionPDF);
 
   // return black if there's just one light and we just hit it
   if (isLight && numLights == 1) return make_float3(0.f);
 
-  // Sample Light
-  float3 emission = Light_Emissions[index];
-  float3 Wi = Light_Sample[index](P, Wo, N, seed);
-  float lightPDF = Light_PDF[index](P, Wo, Wi, N);
+  // Multiple Importance Sample
 
-  // only sample if surface normal is in the light direction
-  if (dot(Wi, N) < 0.f) return make_float3(0.f);
+  // Sample light. A sample below the surface or behind an occluder only
+  // skips this term, the BRDF sample below still runs.
+  float lightPDF;
+  float3 Wi = Light_Sample[index](P, Wo, N, sampler, lightPDF);
+  bool isInfinite = index == Environment_Light;
 
-  // Check if light is occluded
-  PerRayData_Shadow prdShadow;
-  prdShadow.normal = N;
-  Ray shadowRay = make_Ray(/* origin   : */ P,
-                           /* direction: */ Wi,
-                           /* ray type : */ 1,
-                           /* tmin     : */ 1e-3f,
-                           /* tmax     : */ RT_DEFAULT_MAX);
-  rtTrace(world, shadowRay, prdShadow);
+  if (dot(Wi, N) >= 0.f && lightPDF != 0.f) {
+    float3 emission = Light_Emission(index, Wi);
 
-  // if light is occluded, return black
-  if (prdShadow.inShadow) return make_float3(0.f);
+    // Shadow rays stop right before the sampled point, so they don't hit
+    // the light itself
+    float tmax = isInfinite ? RT_DEFAULT_MAX : length(Wi) - 1e-3f;
+    if (!isNull(emission) && !Occluded(P, Wi, N, tmax)) {
+      float matPDF;
+      float3 matValue = Evaluate(surface, P, Wo, Wi, N, matPDF);
 
-  // Multiple Importance Sample
+      if (matPDF != 0.f && !isNull(matValue)) {
+        float weight = PowerHeuristic(1, selectionPDF * lightPDF, 1, matPDF);
+        if (Light_Is_Mesh[index]) weight = 1.f;
 
-  // Sample light
-  if (lightPDF != 0.f && !isNull(emission)) {
-    float matPDF;
-    float3 matValue = Evaluate(surface, P, Wo, Wi, N, matPDF);
-
-    if (matPDF != 0.f && !isNull(matValue)) {
-      float weight = PowerHeuristic(1, lightPDF, 1, matPDF);
-      directLight += matValue * emission * weight / lightPDF;
+        directLight += matValue * emission * weight / lightPDF;
+      }
     }
   }
 
+  if (Light_Is_Mesh[index]) return directLight / selectionPDF;
+
   // Sample BRDF
-  Wi = Sample(surface, P, Wo, N, seed);
+  Wi = Sample(surface, P, Wo, N, sampler);
   float matPDF;
   float3 matValue = Evaluate(surface, P, Wo, Wi, N, matPDF);
 
   if (matPDF != 0.f && !isNull(matValue)) {
     lightPDF = Light_PDF[index](P, Wo, Wi, N);
+    float3 emission = Light_Emission(index, Wi);
 
     // we didn't hit anything, ignore BRDF sample
-    if (!lightPDF || isNull(emission)) return directLight;
+    if (!lightPDF || isNull(emission)) return directLight / selectionPDF;
+
+    // the environment is behind everything else, so it needs its own test
+    if (isInfinite && Occluded(P, Wi, N, RT_DEFAULT_MAX))
+      return directLight / selectionPDF;
 
-    float weight = PowerHeuristic(1, matPDF, 1, lightPDF);
+    float weight = PowerHeuristic(1, matPDF, 1, selectionPDF * lightPDF);
     directLight += matValue * emission * weight / matPDF;
   }
 
-  return directLight;
+  return directLight / selectionPDF;
 }
 
 #endif
\ No newline at end of file
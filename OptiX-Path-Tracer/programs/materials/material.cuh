@@ -22,11 +22,24 @@
 #include "../vec.hpp"
 
 // Typedef of Texture callable program calls
-typedef rtCallableProgramId<float3(float, float, float3, int)> Texture_Function;
+typedef rtCallableProgramId<float3(float, float, float3, int, float)>
+    Texture_Function;
 
 // Typedef of geometry parameters callable program calls
 typedef rtCallableProgramX<HitRecord(int, Ray, float, float2)> HitRecord_Function;
 
+// Returns the width in texture coordinates of the ray cone where it hits the
+// surface, used to select texture mip levels
+RT_FUNCTION float Texture_Footprint(const PerRayData &prd,
+                                   const HitRecord &rec, float t_hit) {
+  float width = prd.coneWidth + prd.coneSpread * t_hit;
+
+  // grazing hits stretch the footprint along the surface
+  float cosine = fmaxf(fabsf(dot(rec.Wo, rec.geometric_normal)), 0.1f);
+
+  return width * rec.texScale / cosine;
+}
+
 RT_FUNCTION float schlick(float cosine, float ref_idx) {
   float r0 = (1.f - ref_idx) / (1.f + ref_idx);
   r0 = r0 * r0;
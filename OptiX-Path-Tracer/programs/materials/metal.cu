@@ -41,12 +41,13 @@ RT_PROGRAM void closest_hit() {
   float3 P = rec.P;               // Hit Point
   float3 Wo = rec.Wo;             // Ray view direction
   float3 N = rec.shading_normal;  // normal
+  float footprint = Texture_Footprint(prd, rec, t_hit);  // texture filter
 
-  float3 color = sample_texture(rec.u, rec.v, P, index);
+  float3 color = sample_texture(rec.u, rec.v, P, index, footprint);
 
   // reflect ray
   float3 reflected = reflect(-Wo, N);
-  prd.direction = reflected + fuzz * random_in_unit_sphere(prd.seed);
+  prd.direction = reflected + fuzz * random_in_unit_sphere(prd.sampler);
 
   // Assign parameters to PRD
   prd.scatterEvent = rayGotBounced;
@@ -11,7 +11,6 @@
 // OptiX Context objects
 rtDeclareVariable(Ray, ray, rtCurrentRay, );                // current ray
 rtDeclareVariable(PerRayData, prd, rtPayload, );            // ray PRD
-rtDeclareVariable(rtObject, world, , );                     // scene graph
 rtDeclareVariable(float, t_hit, rtIntersectionDistance, );  // hit distance
 
 // Intersected Geometry Parameters
@@ -25,10 +24,11 @@ rtDeclareVariable(float, nu, , );
 rtDeclareVariable(float, nv, , );
 
 RT_FUNCTION Torrance_Sparrow_Parameters Get_Parameters(const float3 &P, float u,
-                                                       float v, int index) {
+                                                       float v, int index,
+                                                       float footprint) {
   Torrance_Sparrow_Parameters surface;
 
-  surface.color = sample_texture(u, v, P, index);
+  surface.color = sample_texture(u, v, P, index, footprint);
   surface.nu = nu;
   surface.nv = nv;
 
@@ -42,11 +42,13 @@ RT_PROGRAM void closest_hit() {
   float3 P = rec.P;               // Hit Point
   float3 Wo = rec.Wo;             // Ray view direction
   float3 N = rec.shading_normal;  // normal
+  float footprint = Texture_Footprint(prd, rec, t_hit);  // texture filter
 
-  Torrance_Sparrow_Parameters surface = Get_Parameters(P, rec.u, rec.v, index);
+  Torrance_Sparrow_Parameters surface =
+      Get_Parameters(P, rec.u, rec.v, index, footprint);
 
   // Sample BRDF
-  float3 Wi = Sample(surface, P, Wo, N, prd.seed);
+  float3 Wi = Sample(surface, P, Wo, N, prd.sampler);
   float pdf;  // calculated in the Evaluate function
   float3 attenuation = Evaluate(surface, P, Wo, Wi, N, pdf);
 
@@ -11,7 +11,7 @@ RT_FUNCTION float3 Sample(const Torrance_Sparrow_Parameters &surface,
                           const float3 &P,   // next ray origin
                           const float3 &Wo,  // prev ray direction
                           const float3 &N,   // shading normal
-                          uint &seed) {
+                          Sampler &sampler) {
   // Get material params from input variable
   float nu = surface.nu;
   float nv = surface.nv;
@@ -22,7 +22,7 @@ RT_FUNCTION float3 Sample(const Torrance_Sparrow_Parameters &surface,
   float3 B = cross(T, Nn);
 
   // random variables
-  float2 random = make_float2(rnd(seed), rnd(seed));
+  float2 random = make_float2(rnd(sampler), rnd(sampler));
 
   // get half vector and rotate it to world space
   float3 H = normalize(GGX_Sample(Wo, random, nu, nv));
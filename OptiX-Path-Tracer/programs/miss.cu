@@ -14,6 +14,7 @@
 // limitations under the License.                                           //
 // ======================================================================== //
 
+#include "environment.cuh"
 #include "materials/material.cuh"
 
 // OptiX Context objects
@@ -32,8 +33,8 @@ RT_PROGRAM void gradient_color() {
   const float t = 0.5f * (unit_direction.y + 1.f);
 
   // make gradient color
-  float3 c = (1.f - t) * sample_color1(0, 0, make_float3(0.f), 0);
-  c += t * sample_color2(0, 0, make_float3(0.f), 0);
+  float3 c = (1.f - t) * sample_color1(0, 0, make_float3(0.f), 0, 0.f);
+  c += t * sample_color2(0, 0, make_float3(0.f), 0, 0.f);
 
   prd.throughput *= c;
   prd.scatterEvent = rayMissed;
@@ -41,7 +42,7 @@ RT_PROGRAM void gradient_color() {
 
 // Constant Color Background
 RT_PROGRAM void constant_color() {
-  prd.throughput *= sample_texture(0, 0, make_float3(0.f), 0);
+  prd.throughput *= sample_texture(0, 0, make_float3(0.f), 0, 0.f);
   prd.scatterEvent = rayMissed;
 }
 
@@ -54,7 +55,7 @@ RT_PROGRAM void image_background() {
   float u = (theta + M_PIf) * (0.5f * M_1_PIf);
   float v = 0.5f * (1.f + sinf(phi));
 
-  prd.throughput *= sample_texture(u, v, make_float3(0.f), 0);
+  prd.throughput *= sample_texture(u, v, make_float3(0.f), 0, 0.f);
   prd.scatterEvent = rayMissed;
 }
 
@@ -62,34 +63,8 @@ RT_PROGRAM void image_background() {
 rtDeclareVariable(int, isSpherical, , );
 
 RT_PROGRAM void environmental_mapping() {
-  float u, v;
+  float2 uv = Environment_UV(ray.direction, isSpherical);
 
-  // spherical HDRI mapping
-  if (isSpherical) {
-    // https://www.gamedev.net/forums/topic/637220-equirectangular-environment-map/
-    float r = length(ray.direction);
-    float lon = atan2(ray.direction.z, ray.direction.x);
-    float lat = acos(ray.direction.y / r);
-
-    float2 rads = make_float2(1.f / (PI_F * 2.f), 1.f / PI_F);
-    u = lon * rads.x;
-    v = lat * rads.y;
-  }
-
-  // cylindrical HDRI mapping
-  else {
-    // Y is up, swap x for y and z for x
-    float theta = atan2f(ray.direction.x, ray.direction.z);
-
-    // wrap around full circle if negative
-    theta = theta < 0.f ? theta + (2.f * PI_F) : theta;
-    float phi = acosf(ray.direction.y);
-
-    // map theta and phi to u and v texturecoordinates in [0,1] x [0,1] range
-    u = 1.f - (theta / (2.f * PI_F));
-    v = phi / PI_F;
-  }
-
-  prd.throughput *= 2.f * sample_texture(u, v, make_float3(0.f), 0);
+  prd.throughput *= 2.f * sample_texture(uv.x, uv.y, make_float3(0.f), 0, 0.f);
   prd.scatterEvent = rayMissed;
-}
\ No newline at end of file
+}
@@ -0,0 +1,93 @@
+#include "../environment.cuh"
+#include "pdf.cuh"
+
+// Environment map and its sampling distribution. Texels are weighted by
+// luminance and by the solid angle they cover.
+rtDeclareVariable(rtCallableProgramId<float3(float, float, float3, int, float)>,
+                  sample_texture, , );
+rtDeclareVariable(int, isSpherical, , );
+rtBuffer<float> marginal_cdf;        // cumulative probability of each row
+rtBuffer<float, 2> conditional_cdf;  // cumulative probability in each row
+
+// Index of the first row whose CDF is above x
+RT_FUNCTION int Find_Row(float x) {
+  int first = 0, last = (int)marginal_cdf.size() - 1;
+
+  while (first < last) {
+    int middle = (first + last) / 2;
+    if (marginal_cdf[middle] <= x)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+
+  return first;
+}
+
+// Index of the first column of a row whose CDF is above x
+RT_FUNCTION int Find_Column(int row, float x) {
+  int first = 0, last = (int)conditional_cdf.size().x - 1;
+
+  while (first < last) {
+    int middle = (first + last) / 2;
+    if (conditional_cdf[make_uint2(middle, row)] <= x)
+      first = middle + 1;
+    else
+      last = middle;
+  }
+
+  return first;
+}
+
+// Solid angle PDF of sampling a direction
+RT_CALLABLE_PROGRAM float PDF(const float3 &P,    // origin of next ray
+                              const float3 &Wo,   // direction of current ray
+                              const float3 &Wi,   // direction of next ray
+                              const float3 &N) {  // geometric normal
+  int width = (int)conditional_cdf.size().x;
+  int height = (int)conditional_cdf.size().y;
+
+  float2 uv = Environment_UV(Wi, isSpherical);
+  float sinTheta = sinf(PI_F * uv.y);
+  if (sinTheta <= 0.f) return 0.f;
+
+  // texel under the direction, u might be negative for spherical maps
+  int column = min((int)((uv.x - floorf(uv.x)) * width), width - 1);
+  int row = min((int)(uv.y * height), height - 1);
+
+  float rowPDF = marginal_cdf[row];
+  if (row > 0) rowPDF -= marginal_cdf[row - 1];
+
+  float columnPDF = conditional_cdf[make_uint2(column, row)];
+  if (column > 0) columnPDF -= conditional_cdf[make_uint2(column - 1, row)];
+
+  // texture space density to solid angle density
+  return rowPDF * columnPDF * width * height / (2.f * PI_F * PI_F * sinTheta);
+}
+
+// Sample the environment map proportionally to its luminance
+RT_CALLABLE_PROGRAM float3 Sample(const float3 &P,   // next ray origin
+                                  const float3 &Wo,  // previous ray direction
+                                  const float3 &N,   // geometric normal
+                                  Sampler &sampler, float &pdf) {
+  int width = (int)conditional_cdf.size().x;
+  int height = (int)conditional_cdf.size().y;
+
+  int row = Find_Row(rnd(sampler));
+  int column = Find_Column(row, rnd(sampler));
+
+  // uniform inside the texel
+  float u = (column + rnd(sampler)) / width;
+  float v = (row + rnd(sampler)) / height;
+
+  float3 Wi = Environment_Direction(u, v, isSpherical);
+  pdf = PDF(P, Wo, Wi, N);
+
+  return Wi;
+}
+
+// Environment radiance in a direction, matching the miss program
+RT_CALLABLE_PROGRAM float3 Radiance(const float3 &Wi) {
+  float2 uv = Environment_UV(Wi, isSpherical);
+  return 2.f * sample_texture(uv.x, uv.y, make_float3(0.f), 0, 0.f);
+}
@@ -0,0 +1,45 @@
+#include "pdf.cuh"
+
+// Emissive triangles in world space, three vertices each, picked by area
+// with an alias table
+rtBuffer<float3> light_vertices;
+rtBuffer<float> triangle_threshold;
+rtBuffer<int> triangle_alias;
+rtDeclareVariable(float, total_area, , );
+
+// Mesh lights are only light sampled, so BSDF samples never need their PDF
+RT_CALLABLE_PROGRAM float PDF(const float3 &P,    // origin of next ray
+                              const float3 &Wo,   // direction of current ray
+                              const float3 &Wi,   // direction of next ray
+                              const float3 &N) {  // geometric normal
+  return 0.f;
+}
+
+// Sample a point uniformly over the mesh area
+RT_CALLABLE_PROGRAM float3 Sample(const float3 &P,   // next ray origin
+                                  const float3 &Wo,  // previous ray direction
+                                  const float3 &N,   // geometric normal
+                                  Sampler &sampler, float &pdf) {
+  int count = (int)triangle_alias.size();
+  float x = rnd(sampler) * count;
+  int index = min((int)x, count - 1);
+  if (x - index >= triangle_threshold[index]) index = triangle_alias[index];
+
+  float3 a = light_vertices[3 * index + 0];
+  float3 b = light_vertices[3 * index + 1];
+  float3 c = light_vertices[3 * index + 2];
+
+  // uniform barycentrics
+  float su = sqrtf(rnd(sampler)), r = rnd(sampler);
+  float3 random_point = a * (1.f - su) + b * (su * (1.f - r)) + c * (su * r);
+
+  // area density to solid angle density, lights are two sided
+  float3 Wi = random_point - P;
+  float3 normal = cross(b - a, c - a);
+  float distance_squared = squared_length(Wi);
+  float cosine =
+      fabsf(dot(normal, Wi)) / (length(normal) * sqrtf(distance_squared));
+  pdf = cosine > 0.f ? distance_squared / (cosine * total_area) : 0.f;
+
+  return Wi;
+}
@@ -116,31 +116,40 @@ RT_CALLABLE_PROGRAM float PDF_Z(const float3 &P,    // origin of next ray
 RT_CALLABLE_PROGRAM float3 Sample_X(const float3 &P,   // next ray origin
                                     const float3 &Wo,  // previous ray direction
                                     const float3 &N,   // geometric normal
-                                    uint &seed) {
+                                    Sampler &sampler, float &pdf) {
   float3 random_point = make_float3(k,                            // X
-                                    a0 + rnd(seed) * (a1 - a0),   // Y
-                                    b0 + rnd(seed) * (b1 - b0));  // Z
-  return random_point - P;
+                                    a0 + rnd(sampler) * (a1 - a0),   // Y
+                                    b0 + rnd(sampler) * (b1 - b0));  // Z
+  float3 Wi = random_point - P;
+  pdf = PDF_X(P, Wo, Wi, N);
+
+  return Wi;
 }
 
 // Sample Y-axis aligned rectangle
 RT_CALLABLE_PROGRAM float3 Sample_Y(const float3 &P,   // next ray origin
                                     const float3 &Wo,  // previous ray direction
                                     const float3 &N,   // geometric normal
-                                    uint &seed) {
-  float3 random_point = make_float3(a0 + rnd(seed) * (a1 - a0),   // X
+                                    Sampler &sampler, float &pdf) {
+  float3 random_point = make_float3(a0 + rnd(sampler) * (a1 - a0),   // X
                                     k,                            // Y
-                                    b0 + rnd(seed) * (b1 - b0));  // Z
-  return random_point - P;
+                                    b0 + rnd(sampler) * (b1 - b0));  // Z
+  float3 Wi = random_point - P;
+  pdf = PDF_Y(P, Wo, Wi, N);
+
+  return Wi;
 }
 
 // Sample Z-axis aligned rectangle
 RT_CALLABLE_PROGRAM float3 Sample_Z(const float3 &P,   // next ray origin
                                     const float3 &Wo,  // previous ray direction
                                     const float3 &N,   // geometric normal
-                                    uint &seed) {
-  float3 random_point = make_float3(a0 + rnd(seed) * (a1 - a0),  // X
-                                    b0 + rnd(seed) * (b1 - b0),  // Y
+                                    Sampler &sampler, float &pdf) {
+  float3 random_point = make_float3(a0 + rnd(sampler) * (a1 - a0),  // X
+                                    b0 + rnd(sampler) * (b1 - b0),  // Y
                                     k);                          // Z
-  return random_point - P;
+  float3 Wi = random_point - P;
+  pdf = PDF_Z(P, Wo, Wi, N);
+
+  return Wi;
 }
\ No newline at end of file
@@ -49,13 +49,14 @@ RT_CALLABLE_PROGRAM float PDF(const float3 &P,    // origin of next ray
     return 0.f;
 }
 
-// Sample direction relative to sphere
+// Sample direction relative to sphere, returning the vector to the sampled
+// point on it
 RT_CALLABLE_PROGRAM float3 Sample(const float3 &P,   // next ray origin
                                   const float3 &Wo,  // previous ray direction
                                   const float3 &N,   // geometric normal
-                                  uint &seed) {
-  float r1 = rnd(seed);
-  float r2 = rnd(seed);
+                                  Sampler &sampler, float &pdf) {
+  float r1 = rnd(sampler);
+  float r2 = rnd(sampler);
 
   float distance_squared = squared_length(center - P);
   float z = 1.f + r2 * (sqrtf(1.f - radius * radius / distance_squared) - 1.f);
@@ -65,10 +66,18 @@ RT_CALLABLE_PROGRAM float3 Sample(const float3 &P,   // next ray origin
   float x = cosf(phi) * sqrtf(1.f - z * z);
   float y = sinf(phi) * sqrtf(1.f - z * z);
 
+  // cone around the direction to the sphere center
   float3 Wi = make_float3(x, y, z);
-
-  Onb uvw(normalize(Wi));
+  Onb uvw(normalize(center - P));
   uvw.inverse_transform(Wi);
 
-  return Wi;
-}
\ No newline at end of file
+  // nearest intersection with the sphere, the cone always hits it
+  const float3 oc = P - center;
+  const float b = dot(oc, Wi);
+  const float c = dot(oc, oc) - radius * radius;
+  float t = -b - sqrtf(fmaxf(b * b - c, 0.f));
+
+  pdf = PDF(P, Wo, Wi, N);
+
+  return Wi * t;
+}
@@ -38,16 +38,20 @@ struct HitRecord {
   float3 geometric_normal;
   float3 shading_normal;
   float3 Wo;  // view direction(i.e. direction to camera)
+  float texScale;  // texcoord change per world unit, 0 disables filtering
 };
 
 // Radiance PRD containing variables that should be propagated as the ray
 // scatters. It's also how the closest hit and ray gen programs communicate.
 struct PerRayData {
   // data related to the current sample
-  uint seed;
+  Sampler sampler;
   float time;
   float3 throughput, radiance;
 
+  // ray cone, used to filter textures
+  float coneWidth, coneSpread;
+
   // data related to the last hit
   ScatterEvent scatterEvent;
   bool isSpecular;
@@ -68,3 +68,125 @@ static __host__ __device__ __inline__ unsigned int rot_seed(
     unsigned int seed, unsigned int frame) {
   return seed ^ frame;
 }
+
+// Integer hash with good avalanche, used to decorrelate scrambling seeds
+static __host__ __device__ __inline__ unsigned int hash(unsigned int x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+static __host__ __device__ __inline__ unsigned int reverse_bits(
+    unsigned int x) {
+#ifdef __CUDA_ARCH__
+  return __brev(x);
+#else
+  x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+  x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+  x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+  x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+  return (x >> 16) | (x << 16);
+#endif
+}
+
+// Owen scrambling of a bit reversed value, from "Practical Hash-based Owen
+// Scrambling" by Brent Burley
+static __host__ __device__ __inline__ unsigned int laine_karras_permutation(
+    unsigned int x, unsigned int seed) {
+  x ^= x * 0x3d20adeau;
+  x += seed;
+  x *= (seed >> 16) | 1u;
+  x ^= x * 0x05526c56u;
+  x ^= x * 0x53a22864u;
+  return x;
+}
+
+static __host__ __device__ __inline__ unsigned int nested_uniform_scramble(
+    unsigned int x, unsigned int seed) {
+  x = reverse_bits(x);
+  x = laine_karras_permutation(x, seed);
+  return reverse_bits(x);
+}
+
+// First two dimensions of the Sobol sequence
+static __host__ __device__ __inline__ uint2 sobol_2d(unsigned int index) {
+  unsigned int x = reverse_bits(index), y = 0u;
+
+  for (unsigned int v = 1u << 31; index; index >>= 1, v ^= v >> 1)
+    if (index & 1u) y ^= v;
+
+  return make_uint2(x, y);
+}
+
+typedef enum {
+  RANDOM_SAMPLER,
+  SOBOL_SAMPLER,
+  BLUE_NOISE_SAMPLER
+} Sampler_Type;
+
+// number of leading dimensions dithered by blue noise samplers
+#define BLUE_NOISE_DIMENSIONS 4
+
+// Source of the random numbers of a path. Random samplers keep an LCG stream
+// per sample. Sobol samplers pad 2D Owen scrambled Sobol points: each pair of
+// dimensions gets its own shuffle of the sample indices, so consecutive
+// calls are stratified in pairs and uncorrelated across pairs. Blue noise
+// samplers are Sobol samplers whose first dimensions come from the R2
+// sequence instead, shifted by each pixel's blue noise mask values, so the
+// error of neighboring pixels is negatively correlated.
+struct Sampler {
+  unsigned int type;       // Sampler_Type
+  unsigned int seed;       // LCG state or per pixel scrambling seed
+  unsigned int index;      // sample index of the pixel
+  unsigned int dimension;  // number of values drawn so far
+  unsigned int dither;     // blue noise mask values, one byte per dimension
+};
+
+static __host__ __device__ __inline__ Sampler make_Sampler(
+    unsigned int type, unsigned int pixel, unsigned int index,
+    unsigned int dither = 0u) {
+  Sampler sampler;
+  sampler.type = type;
+  sampler.index = index;
+  sampler.dimension = 0u;
+  sampler.dither = dither;
+
+  // low discrepancy samples of a pixel share the seed and differ by index
+  if (type == RANDOM_SAMPLER)
+    sampler.seed = tea<64>(pixel, index);
+  else
+    sampler.seed = tea<16>(pixel, 0u);
+
+  return sampler;
+}
+
+// Generate random float in [0, 1)
+static __host__ __device__ __inline__ float rnd(Sampler &sampler) {
+  if (sampler.type == RANDOM_SAMPLER) return rnd(sampler.seed);
+
+  // the R2 sequence rotates the mask values of each dimension pair from one
+  // sample to the next, in 32 bit fixed point
+  if (sampler.type == BLUE_NOISE_SAMPLER &&
+      sampler.dimension < BLUE_NOISE_DIMENSIONS) {
+    unsigned int shift = (sampler.dither >> (8 * sampler.dimension)) << 24;
+    unsigned int alpha = (sampler.dimension & 1u) ? 2447445413u : 3242174889u;
+    unsigned int x = shift + (1u << 23) + sampler.index * alpha;
+
+    sampler.dimension++;
+    return (float)(x >> 8) / (float)0x01000000;
+  }
+
+  unsigned int pair = sampler.dimension >> 1;
+  unsigned int pairSeed = hash(sampler.seed ^ hash(pair));
+  unsigned int index = nested_uniform_scramble(sampler.index, pairSeed);
+
+  uint2 point = sobol_2d(index);
+  unsigned int x = (sampler.dimension & 1u) ? point.y : point.x;
+  x = nested_uniform_scramble(x, hash(pairSeed ^ sampler.dimension));
+
+  sampler.dimension++;
+  return (float)(x >> 8) / (float)0x01000000;
+}
@@ -22,6 +22,10 @@
 rtDeclareVariable(uint2, pixelID, rtLaunchIndex, );
 rtDeclareVariable(uint2, launchDim, rtLaunchDim, );
 
+// tiled rendering parameters, launches might only cover part of the frame
+rtDeclareVariable(uint2, tile_offset, , );  // tile origin in the frame
+rtDeclareVariable(uint2, frame_size, , );   // full frame dimensions
+
 // ray related state
 rtDeclareVariable(Ray, ray, rtCurrentRay, );
 rtDeclareVariable(PerRayData, prd, rtPayload, );
@@ -30,9 +34,20 @@ rtBuffer<float4, 2> acc_buffer;      // HDR color frame buffer
 rtBuffer<uchar4, 2> display_buffer;  // display buffer
 
 rtDeclareVariable(int, samples, , );  // number of samples
-rtDeclareVariable(int, frame, , );    // frame number
+rtDeclareVariable(int, frame, , );    // index of the launch's first sample
+rtDeclareVariable(int, samples_per_launch, , );  // samples traced per launch
+rtDeclareVariable(int, sampler_type, , );        // Sampler_Type
+rtBuffer<unsigned char, 2> blue_noise;  // tileable dither mask
+
+// adaptive sampling parameters, pixels stop tracing once their estimated
+// relative error gets below the threshold
+rtBuffer<float, 2> moment_buffer;  // sum of squared sample luminances
+rtBuffer<uint, 1> active_pixels;   // number of pixels that haven't converged
+rtDeclareVariable(float, noise_threshold, , );  // 0 disables adaptive sampling
+rtDeclareVariable(int, warmup_samples, , );     // samples before any test
 
 rtDeclareVariable(rtObject, world, , );  // scene/top obj variable
+rtDeclareVariable(int, Environment_Light, , );  // light index, -1 if none
 
 // Camera parameters
 rtDeclareVariable(float3, camera_lower_left_corner, , );
@@ -46,8 +61,8 @@ rtDeclareVariable(float, time0, , );
 rtDeclareVariable(float, time1, , );
 
 struct Camera {
-  static RT_FUNCTION Ray generateRay(float s, float t, uint& seed) {
-    const float3 rd = camera_lens_radius * random_in_unit_disk(seed);
+  static RT_FUNCTION Ray generateRay(float s, float t, Sampler& sampler) {
+    const float3 rd = camera_lens_radius * random_in_unit_disk(sampler);
     const float3 lens_offset = camera_u * rd.x + camera_v * rd.y;
     const float3 origin = camera_origin + lens_offset;
     const float3 direction = camera_lower_left_corner + s * camera_horizontal +
@@ -61,63 +76,135 @@ struct Camera {
   }
 };
 
-RT_FUNCTION float3 color(Ray& ray, uint& seed) {
+// maximum number of bounces of a path
+#define MAX_DEPTH 50
+
+// Starts a path whose camera ray was generated with the given sampler
+RT_FUNCTION PerRayData Init_Path(Sampler& sampler) {
   PerRayData prd;
-  prd.seed = seed;
-  prd.time = time0 + rnd(prd.seed) * (time1 - time0);
+  prd.sampler = sampler;
+  prd.time = time0 + rnd(prd.sampler) * (time1 - time0);
   prd.throughput = make_float3(1.f);
   prd.radiance = make_float3(0.f);
 
+  // ray cone starts at the lens, spreading by one pixel's angle
+  float3 center = camera_lower_left_corner + 0.5f * camera_horizontal +
+                  0.5f * camera_vertical - camera_origin;
+  prd.coneWidth = 0.f;
+  prd.coneSpread = length(camera_vertical) / frame_size.y / length(center);
+
+  return prd;
+}
+
+// Traces one bounce of a path, updating the ray to the next one. Returns
+// false once the path is done, with its color in result.
+RT_FUNCTION bool Trace_Bounce(Ray& ray, PerRayData& prd, int depth,
+                              bool& previousHitSpecular, float3& result) {
+  rtTrace(world, ray, prd);  // Trace a new ray
+
+  // ray got 'lost' to the environment
+  // return attenuation set by miss shader
+  if (prd.scatterEvent == rayMissed) {
+    // environment lights are added unclamped, as Direct_Light does, and a
+    // sampled one was already added by it
+    if (Environment_Light >= 0) {
+      if (depth > 0 && !previousHitSpecular)
+        result = prd.radiance;
+      else
+        result = prd.radiance + prd.throughput;
+    } else
+      result = prd.radiance + clamp(prd.throughput, 0.f, 1.f);
+    return false;
+  }
+
+  // ray hit a light, return radiance
+  else if (prd.scatterEvent == rayHitLight) {
+    // Take care not to double dip
+    if (depth == 0 || previousHitSpecular) prd.radiance += prd.throughput;
+
+    result = prd.radiance;
+    return false;
+  }
+
+  // ray was cancelled, return radiance
+  else if (prd.scatterEvent == rayGotCancelled) {
+    result = prd.radiance;
+    return false;
+  }
+
+  // ray is still alive, and got properly bounced
+  else {
+    // grow the ray cone up to the hit point
+    prd.coneWidth += prd.coneSpread * length(prd.origin - ray.origin);
+
+    // generate a new ray
+    ray = make_Ray(/* origin   : */ prd.origin,
+                   /* direction: */ prd.direction,
+                   /* ray type : */ 0,
+                   /* tmin     : */ 1e-3f,
+                   /* tmax     : */ RT_DEFAULT_MAX);
+
+    // updated specular flag
+    previousHitSpecular = prd.isSpecular;
+  }
+
+  // Russian Roulette Path Termination
+  float prob = max_component(prd.throughput);
+  if (depth > 10) {
+    if (rnd(prd.sampler) >= prob) {
+      result = prd.radiance + prd.throughput;
+      return false;
+    } else
+      prd.throughput *= 1.f / prob;
+  }
+
+  return true;
+}
+
+RT_FUNCTION float3 color(Ray& ray, Sampler& sampler) {
+  PerRayData prd = Init_Path(sampler);
   bool previousHitSpecular = false;
 
   // iterative version of recursion
-  for (int depth = 0; depth < 50; depth++) {
-    rtTrace(world, ray, prd);  // Trace a new ray
-
-    // ray got 'lost' to the environment
-    // return attenuation set by miss shader
-    if (prd.scatterEvent == rayMissed)
-      return prd.radiance + clamp(prd.throughput, 0.f, 1.f);
-
-    // ray hit a light, return radiance
-    else if (prd.scatterEvent == rayHitLight) {
-      // Take care not to double dip
-      if (depth == 0 || previousHitSpecular) prd.radiance += prd.throughput;
-
-      return prd.radiance;
-    }
-
-    // ray was cancelled, return radiance
-    else if (prd.scatterEvent == rayGotCancelled)
-      return prd.radiance;
-
-    // ray is still alive, and got properly bounced
-    else {
-      // generate a new ray
-      ray = make_Ray(/* origin   : */ prd.origin,
-                     /* direction: */ prd.direction,
-                     /* ray type : */ 0,
-                     /* tmin     : */ 1e-3f,
-                     /* tmax     : */ RT_DEFAULT_MAX);
-
-      // updated specular flag
-      previousHitSpecular = prd.isSpecular;
-    }
-
-    // Russian Roulette Path Termination
-    float prob = max_component(prd.throughput);
-    if (depth > 10) {
-      if (rnd(prd.seed) >= prob)
-        return prd.radiance + prd.throughput;
-      else
-        prd.throughput *= 1.f / prob;
-    }
+  for (int depth = 0; depth < MAX_DEPTH; depth++) {
+    float3 result;
+    if (!Trace_Bounce(ray, prd, depth, previousHitSpecular, result))
+      return result;
   }
 
   // recursion did not terminate - cancel it
   return make_float3(0.f);
 }
 
+// Generates the camera ray of a sample of the pixel
+RT_FUNCTION Ray Camera_Ray(uint2 pixel, Sampler& sampler) {
+  // Subpixel jitter: send the ray through a different position inside the
+  // pixel each time, to provide antialiasing.
+  float u = float(pixel.x + rnd(sampler)) / frame_size.x;
+  float v = float(pixel.y + rnd(sampler)) / frame_size.y;
+
+  return Camera::generateRay(u, v, sampler);
+}
+
+// Packs the blue noise mask values of the dithered dimensions. Each
+// dimension reads the tiled mask at a different offset, so they aren't
+// correlated with each other.
+RT_FUNCTION uint blue_noise_dither(uint2 pixel) {
+  const uint2 offsets[BLUE_NOISE_DIMENSIONS] = {
+      {0u, 0u}, {32u, 16u}, {16u, 48u}, {48u, 32u}};
+  uint width = (uint)blue_noise.size().x;
+  uint height = (uint)blue_noise.size().y;
+  uint dither = 0u;
+
+  for (int i = 0; i < BLUE_NOISE_DIMENSIONS; i++) {
+    uint2 p = pixel + offsets[i];
+    uint value = blue_noise[make_uint2(p.x % width, p.y % height)];
+    dither |= value << (8 * i);
+  }
+
+  return dither;
+}
+
 // Remove NaN values
 RT_FUNCTION float3 de_nan(const float3& c) {
   float3 temp = c;
@@ -130,7 +217,8 @@ RT_FUNCTION float3 de_nan(const float3& c) {
 }
 
 RT_FUNCTION uchar4 make_Color(float4 col) {
-  float3 temp = sqrt(make_float3(col.x, col.y, col.z) / (frame + 1));
+  // the alpha channel holds the number of accumulated samples
+  float3 temp = sqrt(make_float3(col.x, col.y, col.z) / col.w);
   temp = clamp(temp, 0.f, 1.f);
 
   int r = int(255.99 * temp.x);  // R
@@ -141,24 +229,219 @@ RT_FUNCTION uchar4 make_Color(float4 col) {
   return make_uchar4(r, g, b, a);
 }
 
+// Checks if the relative standard error of the pixel's mean luminance is
+// below the noise threshold. Dark pixels are compared against a minimum mean,
+// so they don't keep tracing forever.
+RT_FUNCTION bool converged(const float4& acc, float moment) {
+  float n = acc.w;
+  if (n < max(warmup_samples, 2)) return false;
+
+  float mean = luminance(make_float3(acc.x, acc.y, acc.z)) / n;
+  float variance = ffmax(moment - n * mean * mean, 0.f) / (n - 1.f);
+  float error = sqrt(variance / n) / ffmax(mean, 1e-2f);
+
+  return error < noise_threshold;
+}
+
 RT_PROGRAM void renderPixel() {
-  // get RNG seed
-  uint seed = tea<64>(launchDim.x * pixelID.y + pixelID.x, frame);
+  uint2 index = make_uint2(pixelID.x, launchDim.y - pixelID.y - 1);
+
+  // pixel coordinates in the full frame
+  uint2 pixel = pixelID + tile_offset;
 
   // initialize acc buffer if needed
+  float4 acc = (frame == 0) ? make_float4(0.f) : acc_buffer[index];
+
+  // the moment buffer is only allocated when adaptive sampling is on
+  bool adaptive = noise_threshold > 0.f;
+  float moment = (adaptive && frame > 0) ? moment_buffer[index] : 0.f;
+
+  // the last launch might have less samples left to trace
+  int count = min(samples_per_launch, samples - frame);
+
+  uint dither = (sampler_type == BLUE_NOISE_SAMPLER) ? blue_noise_dither(pixel)
+                                                     : 0u;
+
+  for (int s = 0; s < count; s++) {
+    // converged pixels don't need any more samples
+    if (adaptive && converged(acc, moment)) break;
+
+    // samples are indexed by their number, so progressive launches and
+    // checkpoints continue the same sequence
+    Sampler sampler = make_Sampler(sampler_type,
+                                   frame_size.x * pixel.y + pixel.x, frame + s,
+                                   dither);
+
+    // trace ray
+    Ray ray = Camera_Ray(pixel, sampler);
+
+    // accumulate pixel color
+    float3 col = de_nan(color(ray, sampler));
+    acc += make_float4(col.x, col.y, col.z, 1.f);
+
+    float lum = luminance(col);
+    moment += lum * lum;
+  }
+
+  if (adaptive) {
+    moment_buffer[index] = moment;
+    if (!converged(acc, moment)) atomicAdd(&active_pixels[0], 1u);
+  }
+
+  acc_buffer[index] = acc;
+}
+
+// Converts the accumulated colors to the display format. It's a separate entry
+// point, launched only when a preview is requested, so sampling launches don't
+// pay for it.
+RT_PROGRAM void tonemap() {
+  display_buffer[pixelID] = make_Color(acc_buffer[pixelID]);
+}
+
+///////////////////////////////
+// Wavefront path tracing    //
+///////////////////////////////
+
+// The wavefront integrator traces one sample per pixel at a time, with a
+// launch per bounce. Each launch only covers the paths that are still alive,
+// compacted into a queue by the previous one.
+
+// Path state, indexed by the pixel's position in the launch
+rtBuffer<float3> path_origin, path_direction;  // next ray
+rtBuffer<float3> path_throughput, path_radiance;
+rtBuffer<float2> path_cone;     // ray cone width and spread
+rtBuffer<float> path_time;      // motion blur time
+rtBuffer<uint4> path_sampler;   // sampler seed, index, dimension and dither
+rtBuffer<int2> path_state;      // depth, -1 if not sampled, and specular flag
+
+// Two queues of path indices, each bounce reads one and appends the paths
+// that are still alive to the other
+rtBuffer<uint, 2> path_queue;
+rtBuffer<uint> alive_paths;  // paths appended to the output queue
+
+rtDeclareVariable(int, wave, , );      // sample of the launch being traced
+rtDeclareVariable(int, queue_in, , );  // queue read by the launch
+
+RT_FUNCTION void Save_Path(uint id, const Ray& ray, const PerRayData& prd,
+                           int depth, bool previousHitSpecular) {
+  path_origin[id] = ray.origin;
+  path_direction[id] = ray.direction;
+  path_throughput[id] = prd.throughput;
+  path_radiance[id] = prd.radiance;
+  path_cone[id] = make_float2(prd.coneWidth, prd.coneSpread);
+  path_time[id] = prd.time;
+  path_sampler[id] = make_uint4(prd.sampler.seed, prd.sampler.index,
+                                prd.sampler.dimension, prd.sampler.dither);
+  path_state[id] = make_int2(depth, previousHitSpecular);
+}
+
+// Appends a path to the queue the next bounce reads
+RT_FUNCTION void Queue_Path(uint id, int queue) {
+  uint slot = atomicAdd(&alive_paths[0], 1u);
+  path_queue[make_uint2(slot, queue)] = id;
+}
+
+RT_FUNCTION void Load_Path(uint id, Ray& ray, PerRayData& prd) {
+  // camera rays start closer than bounced ones
+  float tmin = (path_state[id].x == 0) ? 1e-6f : 1e-3f;
+  ray = make_Ray(path_origin[id], path_direction[id], 0, tmin, RT_DEFAULT_MAX);
+
+  prd.throughput = path_throughput[id];
+  prd.radiance = path_radiance[id];
+  prd.coneWidth = path_cone[id].x;
+  prd.coneSpread = path_cone[id].y;
+  prd.time = path_time[id];
+
+  uint4 sampler = path_sampler[id];
+  prd.sampler.type = sampler_type;
+  prd.sampler.seed = sampler.x;
+  prd.sampler.index = sampler.y;
+  prd.sampler.dimension = sampler.z;
+  prd.sampler.dither = sampler.w;
+}
+
+// Starts the paths of the wave's sample, queueing them for the first bounce
+RT_PROGRAM void generatePaths() {
+  uint id = launchDim.x * pixelID.y + pixelID.x;
   uint2 index = make_uint2(pixelID.x, launchDim.y - pixelID.y - 1);
-  if (frame == 0) acc_buffer[index] = make_float4(0.f);
+  uint2 pixel = pixelID + tile_offset;
 
-  // Subpixel jitter: send the ray through a different position inside the
-  // pixel each time, to provide antialiasing.
-  float u = float(pixelID.x + rnd(seed)) / launchDim.x;
-  float v = float(pixelID.y + rnd(seed)) / launchDim.y;
+  path_state[id] = make_int2(-1, 0);
+
+  // the last launch might have less samples left to trace
+  int sample = frame + wave;
+  if (sample >= samples) return;
 
-  // trace ray
-  Ray ray = Camera::generateRay(u, v, seed);
+  // converged pixels don't need any more samples
+  bool adaptive = noise_threshold > 0.f;
+  if (adaptive && sample > 0 &&
+      converged(acc_buffer[index], moment_buffer[index]))
+    return;
 
-  // accumulate pixel color
-  float3 col = de_nan(color(ray, seed));
-  acc_buffer[index] += make_float4(col.x, col.y, col.z, 1.f);
-  display_buffer[index] = make_Color(acc_buffer[index]);
-}
\ No newline at end of file
+  uint dither = (sampler_type == BLUE_NOISE_SAMPLER) ? blue_noise_dither(pixel)
+                                                     : 0u;
+  Sampler sampler = make_Sampler(
+      sampler_type, frame_size.x * pixel.y + pixel.x, sample, dither);
+
+  Ray ray = Camera_Ray(pixel, sampler);
+  PerRayData prd = Init_Path(sampler);
+  Save_Path(id, ray, prd, 0, false);
+  Queue_Path(id, 0);
+}
+
+// Traces the next bounce of each queued path
+RT_PROGRAM void extendPaths() {
+  // launched in 1D, over the queued paths
+  uint id = path_queue[make_uint2(pixelID.x, queue_in)];
+
+  Ray ray;
+  PerRayData prd;
+  Load_Path(id, ray, prd);
+
+  int depth = path_state[id].x;
+  bool previousHitSpecular = path_state[id].y;
+
+  float3 result = make_float3(0.f);
+  bool alive = Trace_Bounce(ray, prd, depth, previousHitSpecular, result);
+
+  // paths that don't terminate in time are cancelled
+  if (!alive || depth + 1 >= MAX_DEPTH) {
+    path_radiance[id] = alive ? make_float3(0.f) : result;
+    return;
+  }
+
+  Save_Path(id, ray, prd, depth + 1, previousHitSpecular);
+  Queue_Path(id, 1 - queue_in);
+}
+
+// Adds the colors of the wave's finished paths to the acc buffer
+RT_PROGRAM void accumulatePaths() {
+  uint id = launchDim.x * pixelID.y + pixelID.x;
+  uint2 index = make_uint2(pixelID.x, launchDim.y - pixelID.y - 1);
+
+  // initialize acc buffer if needed
+  bool first = (frame == 0 && wave == 0);
+  float4 acc = first ? make_float4(0.f) : acc_buffer[index];
+
+  // the moment buffer is only allocated when adaptive sampling is on
+  bool adaptive = noise_threshold > 0.f;
+  float moment = (adaptive && !first) ? moment_buffer[index] : 0.f;
+
+  if (path_state[id].x >= 0) {
+    float3 col = de_nan(path_radiance[id]);
+    acc += make_float4(col.x, col.y, col.z, 1.f);
+
+    float lum = luminance(col);
+    moment += lum * lum;
+  }
+
+  // pixels are only counted once per launch, after its last wave
+  int waves = min(samples_per_launch, samples - frame);
+  if (adaptive) {
+    moment_buffer[index] = moment;
+    if (wave == waves - 1 && !converged(acc, moment))
+      atomicAdd(&active_pixels[0], 1u);
+  }
+
+  acc_buffer[index] = acc;
+}
@@ -2,6 +2,7 @@
 
 rtDeclareVariable(float3, color, , );
 
-RT_CALLABLE_PROGRAM float3 sample_texture(float u, float v, float3 p, int i) {
+RT_CALLABLE_PROGRAM float3 sample_texture(float u, float v, float3 p, int i,
+                                          float footprint) {
   return color;
 }
\ No newline at end of file
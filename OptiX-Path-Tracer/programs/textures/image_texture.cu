@@ -1,7 +1,19 @@
 #include "texture.cuh"
 
 rtTextureSampler<float4, 2> data;
+rtDeclareVariable(float, texture_size, , );  // mean of level 0 width and height
+rtDeclareVariable(int, single_channel, , );  // grayscale texture, red only
 
-RT_CALLABLE_PROGRAM float3 sample_texture(float u, float v, float3 p, int i) {
-  return make_float3(tex2D(data, u, v));
-}
\ No newline at end of file
+RT_CALLABLE_PROGRAM float3 sample_texture(float u, float v, float3 p, int i,
+                                          float footprint) {
+  // mip level whose texels match the ray footprint, level 0 if it's unknown
+  float lod = 0.f;
+  if (footprint > 0.f) lod = fmaxf(log2f(footprint * texture_size), 0.f);
+
+  float4 texel = tex2DLod(data, u, v, lod);
+
+  // grayscale textures only fill the red channel
+  if (single_channel) return make_float3(texel.x);
+
+  return make_float3(texel);
+}
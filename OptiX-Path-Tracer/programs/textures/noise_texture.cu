@@ -59,7 +59,8 @@ RT_FUNCTION float turb(float3 p) {
   return fabs(accum);
 }
 
-RT_CALLABLE_PROGRAM float3 sample_texture(float u, float v, float3 p, int i) {
+RT_CALLABLE_PROGRAM float3 sample_texture(float u, float v, float3 p, int i,
+                                          float footprint) {
   float sinValue;
 
   // get value of sin term according to chosen axis
@@ -1,12 +1,13 @@
 #include "texture.cuh"
 
 rtDeclareVariable(int, size, , );
-rtBuffer<rtCallableProgramId<float3(float, float, float3, int)> >
+rtBuffer<rtCallableProgramId<float3(float, float, float3, int, float)> >
     texture_vector;
 
-RT_CALLABLE_PROGRAM float3 sample_texture(float u, float v, float3 p, int i) {
+RT_CALLABLE_PROGRAM float3 sample_texture(float u, float v, float3 p, int i,
+                                          float footprint) {
   if (i >= size || i < 0)
     return make_float3(0.f);
   else
-    return texture_vector[i](u, v, p, 0);
+    return texture_vector[i](u, v, p, 0, footprint);
 }
\ No newline at end of file
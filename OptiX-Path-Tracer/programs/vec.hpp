@@ -81,4 +81,9 @@ inline __host__ __device__ float max_component(float3 a) {
 // return max component of vector
 inline __host__ __device__ float min_component(float3 a) {
   return ffmin(ffmin(a.x, a.y), a.z);
+}
+
+// return luminance of a linear RGB color(Rec. 709 weights)
+inline __host__ __device__ float luminance(float3 a) {
+  return 0.2126f * a.x + 0.7152f * a.y + 0.0722f * a.z;
 }
\ No newline at end of file